@@ -0,0 +1,238 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <memory_resource>
+#include <random>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "../hashmap/unordered_map.h"
+#include "stack_memory_resource.h"
+#include "huge_page_storage.h"
+#include "slab_allocator.h"
+
+constexpr size_t STORAGE_SIZE = 200'000'000;
+constexpr int ELEMENTS = 2'000'000;
+
+template <typename Func>
+long long Measure(Func&& func) {
+    using namespace std::chrono;
+
+    auto start = high_resolution_clock::now();
+    func();
+    auto finish = high_resolution_clock::now();
+    return duration_cast<milliseconds>(finish - start).count();
+}
+
+template <typename Func>
+void Report(const std::string& name, Func&& func) {
+    std::ostringstream oss;
+    for (int i = 0; i < 3; ++i) {
+        oss << Measure(func) << " ";
+    }
+    std::cerr << " " << name << ": " << oss.str() << "ms" << std::endl;
+}
+
+template <typename Alloc>
+void FillList(const Alloc& alloc) {
+    List<int, Alloc> lst(alloc);
+    for (int i = 0; i < ELEMENTS; ++i) {
+        lst.push_back(i);
+    }
+}
+
+void BenchmarkListAllocators() {
+    Report("std::allocator", [] {
+        FillList(std::allocator<int>());
+    });
+
+    Report("StackAllocator<int, N>", [] {
+        auto storage = std::make_unique<StackStorage<STORAGE_SIZE>>();
+        FillList(StackAllocator<int, STORAGE_SIZE>(*storage));
+    });
+
+    Report("StackAllocator<int, 0, DynamicStackStorage>", [] {
+        DynamicStackStorage storage(STORAGE_SIZE);
+        FillList(StackAllocator<int, 0, DynamicStackStorage>(storage));
+    });
+
+    Report("polymorphic_allocator over StackMemoryResource", [] {
+        DynamicStackStorage storage(STORAGE_SIZE);
+        StackMemoryResource<DynamicStackStorage> resource(storage);
+        FillList(std::pmr::polymorphic_allocator<int>(&resource));
+    });
+
+    Report("polymorphic_allocator over monotonic_buffer_resource", [] {
+        std::pmr::monotonic_buffer_resource resource(STORAGE_SIZE);
+        FillList(std::pmr::polymorphic_allocator<int>(&resource));
+    });
+}
+
+// Counts data TLB load misses of the calling thread through perf_event_open.
+// Reports -1 where perf events are unavailable (containers, non-Linux).
+class TlbMissCounter {
+private:
+    int fd_ = -1;
+
+public:
+    TlbMissCounter() {
+#if defined(__linux__)
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB
+                      | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~TlbMissCounter() {
+#if defined(__linux__)
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+#endif
+    }
+
+    template <typename Func>
+    long long count(Func&& func) {
+#if defined(__linux__)
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+            func();
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            long long result = 0;
+            if (read(fd_, &result, sizeof(result)) == sizeof(result)) {
+                return result;
+            }
+            return -1;
+        }
+#endif
+        func();
+        return -1;
+    }
+};
+
+// Builds a list by inserting before random earlier elements, so consecutive
+// nodes land far apart in the arena, then reports traversal time and TLB misses.
+template <typename Storage>
+void TraverseScatteredList(const std::string& name, Storage& storage) {
+    using Alloc = StackAllocator<int, 0, Storage>;
+    const int count = 8'000'000;
+
+    List<int, Alloc> lst{Alloc(storage)};
+    std::vector<typename List<int, Alloc>::iterator> positions;
+    positions.reserve(count);
+    std::mt19937 gen(42);
+    lst.insert(lst.end(), 0);
+    positions.push_back(lst.begin());
+    for (int i = 1; i < count; ++i) {
+        positions.push_back(lst.insert(positions[gen() % positions.size()], i));
+    }
+
+    long long sum = 0;
+    auto traverse = [&] {
+        sum = 0;
+        for (const auto& node: lst) {
+            sum += node;
+        }
+    };
+    Report(name + " traversal", traverse);
+
+    TlbMissCounter counter;
+    std::cerr << " " << name << " dTLB load misses: " << counter.count(traverse) << std::endl;
+}
+
+void BenchmarkHugePages() {
+    const size_t size = 512 * 1024 * 1024;
+    {
+        DynamicStackStorage storage(size);
+        TraverseScatteredList("4 KiB pages", storage);
+    }
+    {
+        HugePageStackStorage storage(size);
+        const char* modes[] = {"explicit huge pages", "transparent huge pages", "regular pages"};
+        std::cerr << " HugePageStackStorage got "
+                  << modes[static_cast<int>(storage.page_mode())] << std::endl;
+        TraverseScatteredList("HugePageStackStorage", storage);
+    }
+}
+
+constexpr int CHURN_KEYS = 200'000;
+constexpr int CHURN_ROUNDS = 10;
+
+// Keeps CHURN_KEYS keys alive while replacing half of them every round, the
+// pattern under which a bump allocator only grows and a slab pool recycles.
+template <typename Alloc>
+UnorderedMap<int, long long, std::hash<int>, std::equal_to<int>, Alloc> ChurnMap(const Alloc& alloc) {
+    UnorderedMap<int, long long, std::hash<int>, std::equal_to<int>, Alloc> map(alloc);
+    for (int i = 0; i < CHURN_KEYS; ++i) {
+        map.emplace(i, i);
+    }
+    for (int round = 0; round < CHURN_ROUNDS; ++round) {
+        int first = round * CHURN_KEYS;
+        for (int i = first; i < first + CHURN_KEYS; i += 2) {
+            map.erase(map.find(i));
+        }
+        for (int i = first + CHURN_KEYS; i < first + 2 * CHURN_KEYS; i += 2) {
+            map.emplace(i, i);
+        }
+        for (int i = first + 1; i < first + CHURN_KEYS; i += 2) {
+            map.erase(map.find(i));
+        }
+        for (int i = first + CHURN_KEYS + 1; i < first + 2 * CHURN_KEYS; i += 2) {
+            map.emplace(i, i);
+        }
+    }
+    return map;
+}
+
+void BenchmarkMapChurn() {
+    using Pair = std::pair<const int, long long>;
+
+    Report("std::allocator", [] {
+        ChurnMap(std::allocator<Pair>());
+    });
+
+    Report("StackAllocator<Pair, 0, DynamicStackStorage>", [] {
+        DynamicStackStorage storage(STORAGE_SIZE);
+        ChurnMap(StackAllocator<Pair, 0, DynamicStackStorage>(storage));
+    });
+
+    Report("SlabAllocator<Pair>", [] {
+        SlabPool<> pool;
+        ChurnMap(SlabAllocator<Pair>(pool));
+    });
+
+    DynamicStackStorage storage(STORAGE_SIZE);
+    auto arena_map = ChurnMap(StackAllocator<Pair, 0, DynamicStackStorage>(storage));
+    std::cerr << " arena used after churn: " << storage.used() / 1024 << " KiB" << std::endl;
+
+    SlabPool<> pool;
+    auto slab_map = ChurnMap(SlabAllocator<Pair>(pool));
+    std::cerr << " SlabPool after churn:" << std::endl;
+    pool.report(std::cerr);
+}
+
+int main() {
+    std::cerr << "List push_back of " << ELEMENTS << " ints:" << std::endl;
+    BenchmarkListAllocators();
+
+    std::cerr << "Scattered List traversal with and without huge pages:" << std::endl;
+    BenchmarkHugePages();
+
+    std::cerr << "UnorderedMap insert/erase churn of " << CHURN_KEYS << " keys:" << std::endl;
+    BenchmarkMapChurn();
+}
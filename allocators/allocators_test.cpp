@@ -0,0 +1,220 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cassert>
+#include <vector>
+#include <memory_resource>
+
+#include "../hashmap/unordered_map.h"
+#include "../shared_ptr/smart_pointers.h"
+#include "tracing_allocator.h"
+#include "stack_memory_resource.h"
+#include "huge_page_storage.h"
+#include "slab_allocator.h"
+
+void TestTracingList() {
+    TracingRegistry registry;
+    {
+        using Alloc = TracingAllocator<int>;
+        List<int, Alloc> lst{Alloc(std::allocator<int>(), registry)};
+        for (int i = 0; i < 10; ++i) {
+            lst.push_back(i);
+        }
+        lst.pop_front();
+
+        auto copy = lst;
+        assert(copy.size() == 9);
+    }
+
+    std::ostringstream text;
+    registry.report_text(text);
+    assert(text.str().find("allocations: 19, deallocations: 19") != std::string::npos);
+    assert(text.str().find("live: 0") != std::string::npos);
+}
+
+void TestTracingUnorderedMap() {
+    TracingRegistry registry;
+    using Alloc = TracingAllocator<std::pair<const int, std::string>>;
+    {
+        UnorderedMap<int, std::string, std::hash<int>, std::equal_to<int>, Alloc> map{
+            Alloc(std::allocator<std::pair<const int, std::string>>(), registry)};
+        for (int i = 0; i < 100; ++i) {
+            map.emplace(i, std::to_string(i));
+        }
+        assert(map.size() == 100);
+        assert(map.at(42) == "42");
+
+        // The pair lives inside the list node, next to its cached hash and the
+        // two links, so the map allocates nodes and never a pair on its own.
+        AllocationStats* pairs = registry.stats<std::pair<const int, std::string>>();
+        assert(pairs->allocations == 0);
+        size_t node_size = 2 * sizeof(void*) + sizeof(size_t)
+                           + sizeof(std::pair<const int, std::string>);
+        std::ostringstream nodes;
+        registry.report_json(nodes);
+        std::string expected = "\"allocations\":100,\"deallocations\":0,\"bytes\":"
+                               + std::to_string(100 * node_size) + ",\"live_bytes\":"
+                               + std::to_string(100 * node_size) + ",";
+        assert(nodes.str().find(expected) != std::string::npos);
+    }
+
+    std::ostringstream json;
+    registry.report_json(json);
+    assert(json.str().front() == '[' && json.str().back() == ']');
+    assert(json.str().find("\"live_bytes\":0,") != std::string::npos);
+    assert(json.str().find("\"allocations\":100,") != std::string::npos);
+}
+
+void TestTracingSharedPtr() {
+    TracingRegistry registry;
+    {
+        TracingAllocator<int> alloc(std::allocator<int>(), registry);
+        auto first = allocateShared<int>(alloc, 5);
+        auto second = allocateShared<int>(alloc, 7);
+        assert(*first + *second == 12);
+    }
+    std::ostringstream text;
+    registry.report_text(text);
+    assert(text.str().find("ControlBlockAllocateShared") != std::string::npos);
+    assert(text.str().find("allocations: 2, deallocations: 2") != std::string::npos);
+}
+
+void TestTracingStackAllocator() {
+    TracingRegistry registry;
+    StackStorage<100'000> storage;
+    using Inner = StackAllocator<int, 100'000>;
+    using Alloc = TracingAllocator<int, Inner>;
+
+    List<int, Alloc> lst{Alloc(Inner(storage), registry)};
+    for (int i = 0; i < 100; ++i) {
+        lst.push_back(i);
+    }
+    std::ostringstream text;
+    registry.report_text(text);
+    assert(text.str().find("allocations: 100,") != std::string::npos);
+}
+
+void TestStackMemoryResource() {
+    DynamicStackStorage storage(1'000'000);
+
+    {
+        using Alloc = StackAllocator<std::pair<const int, int>, 0, DynamicStackStorage>;
+        UnorderedMap<int, int, std::hash<int>, std::equal_to<int>, Alloc> map{Alloc(storage)};
+        for (int i = 0; i < 1000; ++i) {
+            map[i] = i * i;
+        }
+        assert(map.at(30) == 900);
+    }
+    size_t used = storage.used();
+    assert(used > 0);
+
+    StackMemoryResource<DynamicStackStorage> resource(storage);
+    std::pmr::vector<std::pmr::string> strings(&resource);
+    for (int i = 0; i < 100; ++i) {
+        strings.emplace_back(100, 'a' + i % 26);
+    }
+    assert(strings[27] == std::pmr::string(100, 'b'));
+    assert(storage.used() > used);
+
+    List<int, std::pmr::polymorphic_allocator<int>> lst{std::pmr::polymorphic_allocator<int>(&resource)};
+    for (int i = 0; i < 100; ++i) {
+        lst.push_back(i);
+    }
+    assert(lst.size() == 100);
+
+    DynamicStackStorage small(64);
+    StackMemoryResource<DynamicStackStorage> small_resource(small);
+    bool thrown = false;
+    try {
+        std::pmr::vector<int> too_big(1000, 0, &small_resource);
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void TestHugePageStorage() {
+    HugePageStackStorage storage(1'000'000);
+    assert(storage.capacity() % HugePageStackStorage::HUGE_PAGE_SIZE == 0);
+
+    using Alloc = StackAllocator<long double, 0, HugePageStackStorage>;
+    List<long double, Alloc> lst{Alloc(storage)};
+    for (int i = 0; i < 1000; ++i) {
+        lst.push_back(i);
+    }
+    for (auto& x: lst) {
+        assert(reinterpret_cast<uintptr_t>(&x) % alignof(long double) == 0);
+    }
+    assert(storage.used() >= 1000 * sizeof(long double));
+
+    bool thrown = false;
+    try {
+        Alloc(storage).allocate(storage.capacity());
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void TestSlabAllocator() {
+    using Pair = std::pair<const int, long long>;
+
+    StackStorage<1'000'000> storage;
+    SlabPool<StackAllocator<char, 1'000'000>> pool{StackAllocator<char, 1'000'000>(storage)};
+    using Alloc = SlabAllocator<Pair, StackAllocator<char, 1'000'000>>;
+
+    UnorderedMap<int, long long, std::hash<int>, std::equal_to<int>, Alloc> map{Alloc(pool)};
+    for (int i = 0; i < 1000; ++i) {
+        map.emplace(i, i);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        map.erase(map.find(i));
+    }
+    for (int i = 1000; i < 1500; ++i) {
+        map.emplace(i, i);
+    }
+    assert(map.size() == 1000);
+    assert(map.at(1499) == 1499);
+    assert(map.find(2) == map.end());
+
+    // Each element is one list node: two links, the cached hash and the pair.
+    size_t node_size = 2 * sizeof(void*) + sizeof(size_t) + sizeof(Pair);
+    size_t node_class = (node_size - 1) / SlabPool<>::SLOT_ALIGNMENT;
+    assert(pool.stats(node_class).reuses >= 500);
+    assert(pool.stats(node_class).live_slots >= 1000);
+    for (auto& item: map) {
+        assert(reinterpret_cast<uintptr_t>(&item) % alignof(Pair) == 0);
+    }
+
+    std::ostringstream report;
+    pool.report(report);
+    assert(report.str().find("fragmentation") != std::string::npos);
+    assert(pool.fragmentation() >= 0.0 && pool.fragmentation() < 1.0);
+}
+
+int main() {
+    std::cerr << "Starting tests" << std::endl;
+
+    TestTracingList();
+    std::cerr << "TestTracingList (1 of 7) passed" << std::endl;
+
+    TestTracingUnorderedMap();
+    std::cerr << "TestTracingUnorderedMap (2 of 7) passed" << std::endl;
+
+    TestTracingSharedPtr();
+    std::cerr << "TestTracingSharedPtr (3 of 7) passed" << std::endl;
+
+    TestTracingStackAllocator();
+    std::cerr << "TestTracingStackAllocator (4 of 7) passed" << std::endl;
+
+    TestStackMemoryResource();
+    std::cerr << "TestStackMemoryResource (5 of 7) passed" << std::endl;
+
+    TestHugePageStorage();
+    std::cerr << "TestHugePageStorage (6 of 7) passed" << std::endl;
+
+    TestSlabAllocator();
+    std::cerr << "TestSlabAllocator (7 of 7) passed" << std::endl;
+
+    std::cout << 0;
+}
@@ -0,0 +1,111 @@
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Runtime-sized StackStorage whose memory is reserved with mmap and backed by
+// huge pages where the system allows it, so that arena-allocated List nodes
+// spread over hundreds of megabytes need a few dozen TLB entries instead of
+// tens of thousands. It tries, in order:
+//   1. explicit huge pages (MAP_HUGETLB, needs vm.nr_hugepages reserved);
+//   2. an ordinary mapping with madvise(MADV_HUGEPAGE) for transparent huge pages;
+//   3. an ordinary mapping (or operator new outside Linux).
+// page_mode() tells which one was used. Plugs into StackAllocator as
+// StackAllocator<T, 0, HugePageStackStorage>.
+class HugePageStackStorage {
+public:
+    enum class PageMode {
+        EXPLICIT_HUGE_PAGES,
+        TRANSPARENT_HUGE_PAGES,
+        REGULAR_PAGES,
+    };
+
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+private:
+    char* memory_;
+    size_t size_;
+    size_t position_;
+    PageMode mode_;
+
+    void map(size_t size) {
+#if defined(__linux__)
+        size_ = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void* memory = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+        memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        mode_ = PageMode::EXPLICIT_HUGE_PAGES;
+#endif
+        if (memory == MAP_FAILED) {
+            // Transparent huge pages only back 2 MiB-aligned ranges, so over-map
+            // by one huge page and trim both ends to an aligned window.
+            size_t mapped = size_ + HUGE_PAGE_SIZE;
+            char* raw = static_cast<char*>(mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (raw == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            uintptr_t address = reinterpret_cast<uintptr_t>(raw);
+            size_t head = (HUGE_PAGE_SIZE - address % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+            if (head > 0) {
+                munmap(raw, head);
+            }
+            munmap(raw + head + size_, mapped - head - size_);
+            memory = raw + head;
+            mode_ = PageMode::REGULAR_PAGES;
+#if defined(MADV_HUGEPAGE)
+            if (madvise(memory, size_, MADV_HUGEPAGE) == 0) {
+                mode_ = PageMode::TRANSPARENT_HUGE_PAGES;
+            }
+#endif
+        }
+        memory_ = static_cast<char*>(memory);
+#else
+        size_ = size;
+        memory_ = static_cast<char*>(::operator new(size, std::align_val_t{HUGE_PAGE_SIZE}));
+        mode_ = PageMode::REGULAR_PAGES;
+#endif
+    }
+
+public:
+    explicit HugePageStackStorage(size_t size) : position_(0) {
+        map(size);
+    }
+
+    HugePageStackStorage(const HugePageStackStorage&) = delete;
+
+    HugePageStackStorage& operator=(const HugePageStackStorage&) = delete;
+
+    ~HugePageStackStorage() {
+#if defined(__linux__)
+        munmap(memory_, size_);
+#else
+        ::operator delete(memory_, std::align_val_t{HUGE_PAGE_SIZE});
+#endif
+    }
+
+    char* get_memory(size_t count, size_t align) {
+        size_t start = (position_ + align - 1) / align * align;
+        if (start + count > size_ || start + count < start) {
+            throw std::bad_alloc();
+        }
+        position_ = start + count;
+        return memory_ + start;
+    }
+
+    PageMode page_mode() const {
+        return mode_;
+    }
+
+    size_t capacity() const {
+        return size_;
+    }
+
+    size_t used() const {
+        return position_;
+    }
+};
@@ -0,0 +1,233 @@
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+
+// Per-size-class free lists over slabs taken from Upstream. Every SlabAllocator
+// rebound from the same pool shares it, so UnorderedMap's pairs, list nodes and
+// bucket vector all draw from the same dense slabs, and memory released by
+// erase is handed out again to the next node of that size class, whatever its
+// type. Requests above MAX_SLOT_SIZE go straight to Upstream, over-aligned ones
+// to aligned operator new. Like StackStorage, a pool is not thread-safe.
+template <typename Upstream = std::allocator<char> >
+class SlabPool {
+public:
+    static constexpr size_t SLOT_ALIGNMENT = alignof(std::max_align_t);
+    static constexpr size_t MAX_SLOT_SIZE = 512;
+    static constexpr size_t SIZE_CLASSES = MAX_SLOT_SIZE / SLOT_ALIGNMENT;
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+    struct ClassStats {
+        size_t slot_size = 0;
+        size_t slabs = 0;
+        size_t allocations = 0;
+        size_t reuses = 0;
+        size_t deallocations = 0;
+        size_t live_slots = 0;
+        size_t requested_bytes = 0;
+    };
+
+private:
+    // Upstream is used in units of max_align_t, so slabs and large blocks are
+    // suitably aligned even over a byte-granular StackAllocator<char, N>.
+    using Unit = std::max_align_t;
+    using UnitAllocator = typename std::allocator_traits<Upstream>::template rebind_alloc<Unit>;
+    using upstream_traits_t = std::allocator_traits<UnitAllocator>;
+
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    struct Slab {
+        Slab* next;
+    };
+
+    struct SizeClass {
+        FreeSlot* free_list = nullptr;
+        char* bump = nullptr;
+        char* bump_end = nullptr;
+        ClassStats stats;
+    };
+
+    static constexpr size_t SLAB_HEADER = (sizeof(Slab) + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+
+    UnitAllocator upstream_;
+    SizeClass classes_[SIZE_CLASSES];
+    Slab* slabs_ = nullptr;
+    size_t large_allocations_ = 0;
+    size_t large_live_bytes_ = 0;
+
+    static size_t class_of(size_t bytes) {
+        return bytes == 0 ? 0 : (bytes - 1) / SLOT_ALIGNMENT;
+    }
+
+    static size_t units(size_t bytes) {
+        return (bytes + sizeof(Unit) - 1) / sizeof(Unit);
+    }
+
+    void refill(SizeClass& size_class) {
+        char* memory = reinterpret_cast<char*>(upstream_traits_t::allocate(upstream_, units(SLAB_SIZE)));
+        Slab* slab = reinterpret_cast<Slab*>(memory);
+        slab->next = slabs_;
+        slabs_ = slab;
+        size_class.bump = memory + SLAB_HEADER;
+        size_class.bump_end = memory + SLAB_SIZE;
+        ++size_class.stats.slabs;
+    }
+
+public:
+    explicit SlabPool(const Upstream& upstream = Upstream()) : upstream_(upstream) {
+        for (size_t i = 0; i < SIZE_CLASSES; ++i) {
+            classes_[i].stats.slot_size = (i + 1) * SLOT_ALIGNMENT;
+        }
+    }
+
+    SlabPool(const SlabPool&) = delete;
+
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    ~SlabPool() {
+        while (slabs_ != nullptr) {
+            Slab* next = slabs_->next;
+            upstream_traits_t::deallocate(upstream_, reinterpret_cast<Unit*>(slabs_), units(SLAB_SIZE));
+            slabs_ = next;
+        }
+    }
+
+    void* allocate(size_t bytes, size_t align) {
+        if (align > SLOT_ALIGNMENT) {
+            return ::operator new(bytes, std::align_val_t{align});
+        }
+        if (bytes > MAX_SLOT_SIZE) {
+            ++large_allocations_;
+            large_live_bytes_ += bytes;
+            return upstream_traits_t::allocate(upstream_, units(bytes));
+        }
+        SizeClass& size_class = classes_[class_of(bytes)];
+        ++size_class.stats.allocations;
+        ++size_class.stats.live_slots;
+        size_class.stats.requested_bytes += bytes;
+        if (size_class.free_list != nullptr) {
+            FreeSlot* slot = size_class.free_list;
+            size_class.free_list = slot->next;
+            ++size_class.stats.reuses;
+            return slot;
+        }
+        size_t slot_size = size_class.stats.slot_size;
+        if (size_class.bump == nullptr || size_class.bump + slot_size > size_class.bump_end) {
+            refill(size_class);
+        }
+        void* result = size_class.bump;
+        size_class.bump += slot_size;
+        return result;
+    }
+
+    void deallocate(void* ptr, size_t bytes, size_t align) {
+        if (align > SLOT_ALIGNMENT) {
+            ::operator delete(ptr, std::align_val_t{align});
+            return;
+        }
+        if (bytes > MAX_SLOT_SIZE) {
+            large_live_bytes_ -= bytes;
+            upstream_traits_t::deallocate(upstream_, static_cast<Unit*>(ptr), units(bytes));
+            return;
+        }
+        SizeClass& size_class = classes_[class_of(bytes)];
+        ++size_class.stats.deallocations;
+        --size_class.stats.live_slots;
+        size_class.stats.requested_bytes -= bytes;
+        FreeSlot* slot = static_cast<FreeSlot*>(ptr);
+        slot->next = size_class.free_list;
+        size_class.free_list = slot;
+    }
+
+    const ClassStats& stats(size_t size_class) const {
+        return classes_[size_class].stats;
+    }
+
+    // Fraction of slab bytes that are not holding a live object: free slots,
+    // unused slab tails and the rounding of objects up to their slot size.
+    double fragmentation() const {
+        size_t slab_bytes = 0;
+        size_t requested = 0;
+        for (const SizeClass& size_class: classes_) {
+            slab_bytes += size_class.stats.slabs * SLAB_SIZE;
+            requested += size_class.stats.requested_bytes;
+        }
+        return slab_bytes == 0 ? 0.0 : 1.0 - static_cast<double>(requested) / slab_bytes;
+    }
+
+    void report(std::ostream& out) const {
+        out << "slot size | slabs | allocations | reused | live slots\n";
+        for (const SizeClass& size_class: classes_) {
+            const ClassStats& stats = size_class.stats;
+            if (stats.allocations == 0) {
+                continue;
+            }
+            out << stats.slot_size << " | " << stats.slabs << " | " << stats.allocations
+                << " | " << stats.reuses << " | " << stats.live_slots << '\n';
+        }
+        out << "large allocations: " << large_allocations_
+            << ", large live bytes: " << large_live_bytes_ << '\n'
+            << "fragmentation: " << fragmentation() << '\n';
+    }
+};
+
+// Allocator over a SlabPool. Rebinding keeps the pool, so all node types of a
+// container share its size classes.
+template <typename T, typename Upstream = std::allocator<char> >
+class SlabAllocator {
+private:
+    SlabPool<Upstream>* pool_;
+
+public:
+    using value_type = T;
+    using pointer = T*;
+    using const_pointer = const T*;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    template <typename U>
+    struct rebind {
+        using other = SlabAllocator<U, Upstream>;
+    };
+
+    SlabAllocator() = delete;
+
+    SlabAllocator(SlabPool<Upstream>& pool) : pool_(&pool) {}
+
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U, Upstream>& other) noexcept : pool_(other.pool_) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(pool_->allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    void deallocate(T* ptr, size_t count) {
+        pool_->deallocate(ptr, sizeof(T) * count, alignof(T));
+    }
+
+    SlabPool<Upstream>& pool() const {
+        return *pool_;
+    }
+
+    template <typename U>
+    bool operator==(const SlabAllocator<U, Upstream>& other) const {
+        return pool_ == other.pool_;
+    }
+
+    template <typename U>
+    bool operator!=(const SlabAllocator<U, Upstream>& other) const {
+        return pool_ != other.pool_;
+    }
+
+    template <typename U, typename OtherUpstream>
+    friend class SlabAllocator;
+};
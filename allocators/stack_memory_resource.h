@@ -0,0 +1,76 @@
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+// StackStorage whose size is chosen at run time. It has the same get_memory
+// interface, so StackAllocator<T, 0, DynamicStackStorage> bump-allocates from it
+// exactly as StackAllocator<T, N> does from a StackStorage<N>, plus one bounds
+// check that throws std::bad_alloc instead of running off the end.
+class DynamicStackStorage {
+private:
+    static constexpr std::align_val_t ALIGNMENT{alignof(std::max_align_t)};
+
+    char* memory_;
+    size_t size_;
+    size_t position_;
+
+public:
+    explicit DynamicStackStorage(size_t size)
+        : memory_(static_cast<char*>(::operator new(size, ALIGNMENT)))
+        , size_(size)
+        , position_(0)
+    {}
+
+    DynamicStackStorage(const DynamicStackStorage&) = delete;
+
+    DynamicStackStorage& operator=(const DynamicStackStorage&) = delete;
+
+    ~DynamicStackStorage() {
+        ::operator delete(memory_, size_, ALIGNMENT);
+    }
+
+    char* get_memory(size_t count, size_t align) {
+        size_t start = (position_ + align - 1) / align * align;
+        if (start + count > size_ || start + count < start) {
+            throw std::bad_alloc();
+        }
+        position_ = start + count;
+        return memory_ + start;
+    }
+
+    size_t capacity() const {
+        return size_;
+    }
+
+    size_t used() const {
+        return position_;
+    }
+};
+
+// std::pmr::memory_resource over any StackStorage-like Storage (StackStorage<N>,
+// AtomicStackStorage<N>, ThreadLocalStackStorage<N>, DynamicStackStorage, ...), so
+// std::pmr containers and std::pmr::polymorphic_allocator<T> can share an arena
+// with StackAllocator-based ones. As with StackAllocator, deallocation is a no-op
+// and memory is reclaimed when the storage itself goes away.
+template <typename Storage>
+class StackMemoryResource: public std::pmr::memory_resource {
+private:
+    Storage* storage_;
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        return storage_->get_memory(bytes, alignment);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit StackMemoryResource(Storage& storage) : storage_(&storage) {}
+
+    Storage& storage() const {
+        return *storage_;
+    }
+};
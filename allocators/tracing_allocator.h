@@ -0,0 +1,301 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <type_traits>
+#include <utility>
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+// Counters for one allocated type. Everything is a relaxed atomic, so a
+// TracingAllocator can be shared between threads and left on in staging.
+struct AllocationStats {
+    static constexpr size_t HISTOGRAM_SIZE = 65;
+
+    std::string type_name;
+
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> deallocations{0};
+    std::atomic<uint64_t> allocated_bytes{0};
+    std::atomic<uint64_t> live_bytes{0};
+    std::atomic<uint64_t> peak_live_bytes{0};
+
+    // histogram[k] counts allocations of [2^(k-1), 2^k) bytes, histogram[0] of 0 bytes.
+    std::atomic<uint64_t> histogram[HISTOGRAM_SIZE] = {};
+
+    explicit AllocationStats(std::string name) : type_name(std::move(name)) {}
+
+    static size_t bucket(size_t bytes) {
+        size_t result = 0;
+        while (bytes > 0) {
+            bytes >>= 1;
+            ++result;
+        }
+        return result;
+    }
+
+    void on_allocate(size_t bytes) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        histogram[bucket(bytes)].fetch_add(1, std::memory_order_relaxed);
+        uint64_t live = live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        uint64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+        while (live > peak
+               && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    }
+
+    void on_deallocate(size_t bytes) {
+        deallocations.fetch_add(1, std::memory_order_relaxed);
+        live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+};
+
+// Owns the AllocationStats of every type traced through it. Each type gets a
+// process-wide slot index the first time it is seen, so after that a lookup is
+// a single atomic load, which matters because containers rebind on the fly.
+class TracingRegistry {
+private:
+    static constexpr size_t MAX_TYPES = 256;
+
+    std::atomic<AllocationStats*> stats_[MAX_TYPES] = {};
+    std::mutex mutex_;
+
+    static size_t next_type_index() {
+        static std::atomic<size_t> next_index(0);
+        return next_index.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template <typename T>
+    static size_t type_index() {
+        static const size_t index = next_type_index();
+        return index;
+    }
+
+    template <typename T>
+    static std::string type_name() {
+        const char* name = typeid(T).name();
+#if defined(__GNUG__)
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        if (status == 0 && demangled != nullptr) {
+            std::string result(demangled);
+            std::free(demangled);
+            return result;
+        }
+#endif
+        return name;
+    }
+
+    static void write_json_string(std::ostream& out, const std::string& str) {
+        out << '"';
+        for (char c: str) {
+            if (c == '"' || c == '\\') {
+                out << '\\';
+            }
+            out << c;
+        }
+        out << '"';
+    }
+
+    template <typename Func>
+    void for_each_stats(Func&& func) const {
+        for (const auto& slot: stats_) {
+            const AllocationStats* stats = slot.load(std::memory_order_acquire);
+            if (stats != nullptr) {
+                func(*stats);
+            }
+        }
+    }
+
+public:
+    TracingRegistry() = default;
+
+    TracingRegistry(const TracingRegistry&) = delete;
+
+    TracingRegistry& operator=(const TracingRegistry&) = delete;
+
+    ~TracingRegistry() {
+        for (auto& slot: stats_) {
+            delete slot.load();
+        }
+    }
+
+    static TracingRegistry& global() {
+        static TracingRegistry registry;
+        return registry;
+    }
+
+    // Stats for T, or nullptr if more than MAX_TYPES types were traced.
+    template <typename T>
+    AllocationStats* stats() {
+        size_t index = type_index<T>();
+        if (index >= MAX_TYPES) {
+            return nullptr;
+        }
+        AllocationStats* result = stats_[index].load(std::memory_order_acquire);
+        if (result == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            result = stats_[index].load(std::memory_order_acquire);
+            if (result == nullptr) {
+                result = new AllocationStats(type_name<T>());
+                stats_[index].store(result, std::memory_order_release);
+            }
+        }
+        return result;
+    }
+
+    void report_text(std::ostream& out) const {
+        for_each_stats([&out](const AllocationStats& stats) {
+            out << stats.type_name << ":\n"
+                << "  allocations: " << stats.allocations.load()
+                << ", deallocations: " << stats.deallocations.load() << '\n'
+                << "  bytes: " << stats.allocated_bytes.load()
+                << ", live: " << stats.live_bytes.load()
+                << ", peak live: " << stats.peak_live_bytes.load() << '\n'
+                << "  sizes:";
+            for (size_t k = 0; k < AllocationStats::HISTOGRAM_SIZE; ++k) {
+                uint64_t count = stats.histogram[k].load();
+                if (count > 0) {
+                    out << " <" << (k == 0 ? 1 : (uint64_t(1) << (k - 1)) * 2) << "B:" << count;
+                }
+            }
+            out << '\n';
+        });
+    }
+
+    void report_json(std::ostream& out) const {
+        out << '[';
+        bool first = true;
+        for_each_stats([&](const AllocationStats& stats) {
+            out << (first ? "" : ",") << "{\"type\":";
+            first = false;
+            write_json_string(out, stats.type_name);
+            out << ",\"allocations\":" << stats.allocations.load()
+                << ",\"deallocations\":" << stats.deallocations.load()
+                << ",\"bytes\":" << stats.allocated_bytes.load()
+                << ",\"live_bytes\":" << stats.live_bytes.load()
+                << ",\"peak_live_bytes\":" << stats.peak_live_bytes.load()
+                << ",\"histogram\":{";
+            bool first_bucket = true;
+            for (size_t k = 0; k < AllocationStats::HISTOGRAM_SIZE; ++k) {
+                uint64_t count = stats.histogram[k].load();
+                if (count > 0) {
+                    out << (first_bucket ? "" : ",") << '"' << k << "\":" << count;
+                    first_bucket = false;
+                }
+            }
+            out << "}}";
+        });
+        out << ']';
+    }
+};
+
+// Wraps any allocator and records every allocate/deallocate in a TracingRegistry,
+// keyed by the value_type after rebinding: List<int, TracingAllocator<int>> reports
+// its nodes, UnorderedMap its pairs, list nodes and bucket iterators separately.
+template <typename T, typename Alloc = std::allocator<T> >
+class TracingAllocator {
+private:
+    using inner_traits_t = std::allocator_traits<Alloc>;
+
+    Alloc inner_;
+    TracingRegistry* registry_;
+    AllocationStats* stats_;
+
+public:
+    using value_type = T;
+    using pointer = T*;
+    using const_pointer = const T*;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+
+    using propagate_on_container_copy_assignment =
+        typename inner_traits_t::propagate_on_container_copy_assignment;
+    using propagate_on_container_move_assignment =
+        typename inner_traits_t::propagate_on_container_move_assignment;
+    using propagate_on_container_swap = typename inner_traits_t::propagate_on_container_swap;
+    using is_always_equal = std::false_type;
+
+    template <typename U>
+    struct rebind {
+        using other = TracingAllocator<U, typename inner_traits_t::template rebind_alloc<U> >;
+    };
+
+    TracingAllocator() : TracingAllocator(Alloc()) {}
+
+    explicit TracingAllocator(const Alloc& inner,
+                              TracingRegistry& registry = TracingRegistry::global())
+        : inner_(inner)
+        , registry_(&registry)
+        , stats_(registry.stats<T>())
+    {}
+
+    template <typename U, typename OtherAlloc>
+    TracingAllocator(const TracingAllocator<U, OtherAlloc>& other)
+        : inner_(other.inner_)
+        , registry_(other.registry_)
+        , stats_(registry_->stats<T>())
+    {}
+
+    T* allocate(size_t count) {
+        T* result = inner_traits_t::allocate(inner_, count);
+        if (stats_ != nullptr) {
+            stats_->on_allocate(count * sizeof(T));
+        }
+        return result;
+    }
+
+    void deallocate(T* ptr, size_t count) {
+        if (stats_ != nullptr) {
+            stats_->on_deallocate(count * sizeof(T));
+        }
+        inner_traits_t::deallocate(inner_, ptr, count);
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* ptr, Args&&... args) {
+        inner_traits_t::construct(inner_, ptr, std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    void destroy(U* ptr) {
+        inner_traits_t::destroy(inner_, ptr);
+    }
+
+    size_t max_size() const {
+        return inner_traits_t::max_size(inner_);
+    }
+
+    TracingAllocator select_on_container_copy_construction() const {
+        return TracingAllocator(inner_traits_t::select_on_container_copy_construction(inner_),
+                                *registry_);
+    }
+
+    const Alloc& inner_allocator() const {
+        return inner_;
+    }
+
+    TracingRegistry& registry() const {
+        return *registry_;
+    }
+
+    template <typename U, typename OtherAlloc>
+    bool operator==(const TracingAllocator<U, OtherAlloc>& other) const {
+        return registry_ == other.registry_ && inner_ == other.inner_;
+    }
+
+    template <typename U, typename OtherAlloc>
+    bool operator!=(const TracingAllocator<U, OtherAlloc>& other) const {
+        return !(*this == other);
+    }
+
+    template <typename U, typename OtherAlloc>
+    friend class TracingAllocator;
+};
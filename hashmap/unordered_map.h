@@ -1,10 +1,29 @@
+#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <new>
 #include <stdexcept>
 #include <list>
 #include <utility>
 #include <cstdlib>
 #include <cstddef>
+#include <cstring>
+#include <exception>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <iostream>
 #include <cassert>
@@ -28,10 +47,118 @@ public:
     }
 };
 
-template <typename T, size_t N>
+// StackStorage that may be shared between threads: every allocation is a single
+// fetch_add on position_. Sizes are rounded up to ALIGNMENT so that position_
+// stays aligned for every fundamental type without a CAS loop.
+template <size_t N>
+class alignas(std::max_align_t) AtomicStackStorage {
+private:
+    static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+
+    char memory_[N];
+    std::atomic<size_t> position_;
+
+public:
+    AtomicStackStorage() : position_(0) {}
+
+    AtomicStackStorage(const AtomicStackStorage&) = delete;
+
+    AtomicStackStorage& operator=(const AtomicStackStorage&) = delete;
+
+    // Throws std::bad_alloc if the request runs past the end. The failed
+    // request still advances position_, so the arena counts as full from then on.
+    char* get_memory(size_t count, size_t align) {
+        size_t size = (count + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        if (align > ALIGNMENT) {
+            size += align;
+        }
+        size_t start = position_.fetch_add(size, std::memory_order_relaxed);
+        if (start > N || N - start < size) {
+            throw std::bad_alloc();
+        }
+        if (align <= ALIGNMENT) {
+            return memory_ + start;
+        }
+        return memory_ + (start + align - 1) / align * align;
+    }
+};
+
+inline size_t current_thread_index() {
+    static std::atomic<size_t> next_index(0);
+    thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+// StackStorage shared between threads where each thread bumps a pointer inside
+// its own chunk and only touches the shared atomic position_ to grab the next
+// chunk. The chunks are kept in the storage, one slot per thread index, so a thread
+// that switches between storages never gives up the rest of a chunk. Thread indices
+// are not reused; threads past THREAD_SLOTS allocate straight from position_.
+template <size_t N, size_t ChunkSize = 64 * 1024>
+class alignas(std::max_align_t) ThreadLocalStackStorage {
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr size_t THREAD_SLOTS = 64;
+
+    struct alignas(CACHE_LINE) LocalChunk {
+        char* position = nullptr;
+        char* end = nullptr;
+    };
+
+    char memory_[N];
+    std::atomic<size_t> position_;
+    LocalChunk chunks_[THREAD_SLOTS];
+
+    // Claims up to wanted bytes of the arena, settling for a shorter tail near the
+    // end as long as at least minimum bytes are left. Sets end past the claimed range.
+    char* reserve(size_t wanted, size_t minimum, char*& end) {
+        size_t position = position_.load(std::memory_order_relaxed);
+        size_t size = 0;
+        do {
+            if (N - position < minimum) {
+                throw std::bad_alloc();
+            }
+            size = std::min(wanted, N - position);
+        } while (!position_.compare_exchange_weak(position, position + size, std::memory_order_relaxed));
+        end = memory_ + position + size;
+        return memory_ + position;
+    }
+
+    static char* align_up(char* ptr, size_t align) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+        return ptr + ((address + align - 1) / align * align - address);
+    }
+
+public:
+    ThreadLocalStackStorage() : position_(0) {}
+
+    ThreadLocalStackStorage(const ThreadLocalStackStorage&) = delete;
+
+    ThreadLocalStackStorage& operator=(const ThreadLocalStackStorage&) = delete;
+
+    char* get_memory(size_t count, size_t align) {
+        size_t index = current_thread_index();
+        char* end = nullptr;
+        if (index >= THREAD_SLOTS || count + align > ChunkSize / 4) {
+            return align_up(reserve(count + align, count + align, end), align);
+        }
+        LocalChunk& chunk = chunks_[index];
+        char* start = chunk.position == nullptr ? nullptr : align_up(chunk.position, align);
+        if (start == nullptr || start + count > chunk.end) {
+            chunk.position = reserve(ChunkSize, count + align, chunk.end);
+            start = align_up(chunk.position, align);
+        }
+        chunk.position = start + count;
+        return start;
+    }
+};
+
+// Storage is anything with get_memory(count, align): StackStorage<N> by default,
+// or AtomicStackStorage<N>/ThreadLocalStackStorage<N> to share one arena between threads.
+template <typename T, size_t N, typename Storage = StackStorage<N> >
 class StackAllocator {
 private:
-    StackStorage<N>* storage_;
+    Storage* storage_;
 
 public:
     using value_type = T;
@@ -44,24 +171,24 @@ public:
 
     template <typename U>
     struct rebind {
-        using other = StackAllocator<U, N>;
+        using other = StackAllocator<U, N, Storage>;
     };
 
     StackAllocator() = delete;
 
-    StackAllocator(StackStorage<N>& init_storage) : storage_(&init_storage) {}
+    StackAllocator(Storage& init_storage) : storage_(&init_storage) {}
 
     ~StackAllocator() = default;
 
     template <typename U>
-    StackAllocator(const StackAllocator<U, N>& other) noexcept : storage_(other.storage_) {}
+    StackAllocator(const StackAllocator<U, N, Storage>& other) noexcept : storage_(other.storage_) {}
 
     StackAllocator& operator=(const StackAllocator& other) {
         storage_ = other.storage_;
         return *this;
     }
 
-    T* allocate(size_t count) noexcept {
+    T* allocate(size_t count) {
         return reinterpret_cast<T*>(storage_->get_memory(sizeof(T) * count, alignof(T)));
     }
 
@@ -71,17 +198,17 @@ public:
         return *this;
     }
 
-    template <typename U, size_t M>
-    bool operator==(const StackAllocator<U, M>& other) const {
+    template <typename U, size_t M, typename OtherStorage>
+    bool operator==(const StackAllocator<U, M, OtherStorage>& other) const {
         return true;
     }
 
-    template <typename U, size_t M>
-    bool operator!=(const StackAllocator<U, M>& other) const {
+    template <typename U, size_t M, typename OtherStorage>
+    bool operator!=(const StackAllocator<U, M, OtherStorage>& other) const {
         return false;
     }
 
-    template <typename U, size_t M>
+    template <typename U, size_t M, typename OtherStorage>
     friend class StackAllocator;
 };
 
@@ -379,7 +506,7 @@ public:
         BaseNode* this_after = pos.position_;
         BaseNode* other_before = node->prev;
         BaseNode* other_after = node->next;
-        if (node == this_after) {
+        if (node == this_after || node == this_before) {
             return;
         }
         node->prev = this_before;
@@ -389,14 +516,225 @@ public:
         other_before->next = other_after;
         other_after->prev = other_before;
     }
+
+    // Relinks the list in the order order[0], ..., order[size() - 1], which must
+    // hold every node once. Only the links of the nodes at positions [first, last)
+    // are written, so calls for disjoint ranges may run on different threads; the
+    // list is whole again once every position has been covered.
+    void link_in_order(const iterator* order, size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            BaseNode* node = order[i].position_;
+            node->prev = i == 0 ? fake_ : order[i - 1].position_;
+            node->next = i + 1 == size_ ? fake_ : order[i + 1].position_;
+        }
+        if (first == 0 && last > 0) {
+            fake_->next = order[0].position_;
+        }
+        if (first < last && last == size_) {
+            fake_->prev = order[size_ - 1].position_;
+        }
+    }
+};
+
+// Calls task(0), ..., task(count - 1), each on a thread of its own except
+// task(0), which runs on the calling thread. Returns once all of them are done
+// and rethrows the first exception any of them threw.
+template <typename Func>
+void run_in_parallel(size_t count, Func&& task) {
+    std::vector<std::exception_ptr> errors(count);
+    auto guarded = [&](size_t index) {
+        try {
+            task(index);
+        } catch (...) {
+            errors[index] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+    try {
+        for (size_t index = 1; index < count; ++index) {
+            threads.emplace_back(guarded, index);
+        }
+    } catch (...) {
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        throw;
+    }
+    guarded(0);
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    for (auto& error: errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// Hash mixing for tables that index by the low or high bits of the hash.
+// std::hash of an integer is the identity, so without it sequential keys would
+// all share their high bits. The 128-bit product folds every input bit into
+// every output bit.
+inline size_t mix_hash(size_t hash) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = static_cast<__uint128_t>(hash) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(product) ^ static_cast<size_t>(product >> 64);
+#else
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+#endif
+}
+
+// Hint that ptr will be read soon; the batched lookups issue it one step ahead.
+inline void prefetch(const void* ptr) {
+#if defined(__GNUC__)
+    __builtin_prefetch(ptr);
+#else
+    static_cast<void>(ptr);
+#endif
+}
+
+// When the chained UnorderedMap changes its bucket count. The thresholds are
+// turned into element counts whenever the bucket count changes, so an insert or
+// erase only compares two integers. The fields may be changed freely, with the
+// following in mind:
+//  - initial_bucket_count is what a default-constructed map starts with, and
+//    also the least a shrinking map goes down to;
+//  - max_load_factor is the most elements per bucket before the table grows by
+//    growth_factor;
+//  - the table shrinks on erase once there are fewer than min_load_factor
+//    elements per bucket; zero, the default, never shrinks. A shrink leaves
+//    the load at about max_load_factor / growth_factor, so min_load_factor
+//    should stay well below that, or erasures and inserts around the boundary
+//    would rehash back and forth.
+// The map rejects a growth_factor below 2 or a max_load_factor that is not
+// positive with std::invalid_argument: either would never make room.
+struct GrowthPolicy {
+    size_t initial_bucket_count = 16;
+    size_t growth_factor = 2;
+    double max_load_factor = 1.0;
+    double min_load_factor = 0.0;
+
+    size_t grow_threshold(size_t bucket_count) const {
+        return static_cast<size_t>(static_cast<double>(bucket_count) * max_load_factor);
+    }
+
+    size_t shrink_threshold(size_t bucket_count) const {
+        return static_cast<size_t>(static_cast<double>(bucket_count) * min_load_factor);
+    }
+
+    size_t grown_bucket_count(size_t bucket_count) const {
+        return bucket_count * growth_factor;
+    }
+
+    // Fewest buckets that hold count elements without growing.
+    size_t buckets_for(size_t count) const {
+        return static_cast<size_t>(std::ceil(static_cast<double>(count) / max_load_factor));
+    }
+
+    void validate() const {
+        if (growth_factor < 2) {
+            throw std::invalid_argument("GrowthPolicy: growth_factor must be at least 2");
+        }
+        if (!(max_load_factor > 0.0)) {
+            throw std::invalid_argument("GrowthPolicy: max_load_factor must be positive");
+        }
+    }
 };
 
+// Rehash policies of the chained UnorderedMap: a GrowthPolicy, plus how many
+// buckets a table may have and which bucket a hash goes to. mix is applied once
+// to the result of Hash and the mixed hash is what nodes cache and index takes.
+//
+// ModuloRehashPolicy takes the hash modulo any bucket count. It needs no mixing
+// but costs an integer division for every bucket computed.
+struct ModuloRehashPolicy : GrowthPolicy {
+    static size_t mix(size_t hash) {
+        return hash;
+    }
+
+    static size_t bucket_count(size_t requested) {
+        return std::max<size_t>(requested, 1);
+    }
+
+    static size_t index(size_t hash, size_t bucket_count) {
+        return hash % bucket_count;
+    }
+};
+
+// Power-of-two bucket counts, indexed by the low bits of the mixed hash: a mask
+// instead of a division.
+struct PowerOfTwoRehashPolicy : GrowthPolicy {
+    static size_t mix(size_t hash) {
+        return mix_hash(hash);
+    }
+
+    static size_t bucket_count(size_t requested) {
+        size_t count = 1;
+        while (count < requested) {
+            count *= 2;
+        }
+        return count;
+    }
+
+    static size_t index(size_t hash, size_t bucket_count) {
+        return hash & (bucket_count - 1);
+    }
+};
+
+// Any bucket count, indexed by the high bits of hash * bucket_count (Lemire's
+// fastrange): a multiplication instead of a division. The high bits only depend
+// on the high bits of the hash, hence the mixing.
+struct FastRangeRehashPolicy : GrowthPolicy {
+    static size_t mix(size_t hash) {
+        return mix_hash(hash);
+    }
+
+    static size_t bucket_count(size_t requested) {
+        return std::max<size_t>(requested, 1);
+    }
+
+    static size_t index(size_t hash, size_t bucket_count) {
+#if defined(__SIZEOF_INT128__)
+        return static_cast<size_t>((static_cast<__uint128_t>(hash) * bucket_count) >> 64);
+#else
+        return hash % bucket_count;
+#endif
+    }
+};
+
+// True if Hash and Equal both accept any type comparable with the key, in which
+// case find, at and operator[] take such a type directly instead of building a
+// Key from it first (say, a std::string_view for std::string keys).
+template <typename Hash, typename Equal, typename = void>
+struct is_transparent_lookup : std::false_type {};
+
+template <typename Hash, typename Equal>
+struct is_transparent_lookup<Hash, Equal, std::void_t<typename Hash::is_transparent,
+                                                      typename Equal::is_transparent> >
+    : std::true_type {};
+
+// Storage layouts of UnorderedMap. ChainedLayout keeps every element in its own
+// node on a linked list, so iterators and references survive rehashing;
+// SwissLayout keeps elements inline in an open-addressing table (see SwissTable)
+// for faster lookups, at the cost of invalidating them when the table grows.
+// RobinHoodLayout is open addressing too (see RobinHoodTable), with short and
+// even probe lengths that suit lookups of missing keys.
+struct ChainedLayout {};
+struct SwissLayout {};
+struct RobinHoodLayout {};
+
 template <
     typename Key,
     typename Value,
     typename Hash = std::hash<Key>,
     typename Equal = std::equal_to<Key>,
-    typename Alloc = std::allocator<std::pair<const Key, Value> >
+    typename Alloc = std::allocator<std::pair<const Key, Value> >,
+    typename Layout = ChainedLayout,
+    typename RehashPolicy = ModuloRehashPolicy
 >
 class UnorderedMap {
 public:
@@ -405,14 +743,19 @@ public:
 private:
     using traits_t = std::allocator_traits<Alloc>;
 
+    // The element lives inside the list node, next to its cached hash, so an
+    // entry costs a single allocation and a lookup reads hash, key and value from
+    // one place. The node only reserves room for the element: it is constructed
+    // and destroyed by UnorderedMap through alloc_, as if it were allocated alone.
     struct ListNode {
-        NodeType* key_value;
         size_t hash;
+        union {
+            NodeType key_value;
+        };
 
-        ListNode(NodeType* ptr, size_t hashed)
-            : key_value(ptr)
-            , hash(hashed)
-        {}
+        explicit ListNode(size_t hashed) : hash(hashed) {}
+
+        ~ListNode() {}
     };
 
     using ListAlloc = typename traits_t::template rebind_alloc<ListNode>;
@@ -423,17 +766,107 @@ private:
     using ListTypeIterAlloc = typename traits_t::template rebind_alloc<ListTypeIter>;
     using VectorType = typename std::vector<ListTypeIter, ListTypeIterAlloc>;
 
-    static constexpr double DEFAULT_MAX_LOAD_FACTOR = 1;
-    static const size_t DEFAULT_BUCKET_COUNT = 1;
 
     ListType elements_;
     VectorType iterators_;
-    
+
+    // Buckets of the table being rehashed incrementally, or empty. A node still
+    // belongs to the old table while its old bucket is not empty: buckets move
+    // to iterators_ as a whole and are then set to end().
+    VectorType old_iterators_;
+    size_t migrate_position_;
+    size_t rehash_step_;
+
     Hash hash_;
     Equal equal_;
     Alloc alloc_;
 
-    double max_load_factor_;
+    RehashPolicy policy_;
+    size_t grow_at_;
+    size_t shrink_at_;
+
+    void update_thresholds() {
+        grow_at_ = policy_.grow_threshold(iterators_.size());
+        shrink_at_ = policy_.shrink_threshold(iterators_.size());
+    }
+
+    template <typename K>
+    size_t hash_of(const K& key) const {
+        return RehashPolicy::mix(hash_(key));
+    }
+
+    static size_t bucket_index(size_t hash, const VectorType& buckets) {
+        return RehashPolicy::index(hash, buckets.size());
+    }
+
+    bool in_old_table(ListTypeIter node) const {
+        return !old_iterators_.empty()
+               && old_iterators_[bucket_index(node->hash, old_iterators_)] != elements_.end();
+    }
+
+    // True if node is in the chain of bucket index of iterators_.
+    bool in_new_chain(ListTypeIter node, size_t index) const {
+        return node != elements_.end()
+               && bucket_index(node->hash, iterators_) == index
+               && !in_old_table(node);
+    }
+
+    // Moves node into its bucket of iterators_, as the new head of the chain.
+    void splice_into_bucket(ListTypeIter node) {
+        size_t index = bucket_index(node->hash, iterators_);
+        if (iterators_[index] != elements_.end()) {
+            elements_.splice(iterators_[index], node);
+        } else {
+            elements_.splice(elements_.begin(), node);
+        }
+        iterators_[index] = node;
+    }
+
+    // Moves the whole chain of an old bucket into the new table. The nodes
+    // moved go in front of the chain being walked, so the walk never meets them.
+    void migrate_bucket(size_t index) {
+        ListTypeIter iter = old_iterators_[index];
+        old_iterators_[index] = elements_.end();
+        while (iter != elements_.end() && bucket_index(iter->hash, old_iterators_) == index) {
+            ListTypeIter next = iter;
+            ++next;
+            splice_into_bucket(iter);
+            iter = next;
+        }
+    }
+
+    // Moves the next count old buckets, and drops the old table once all of
+    // them are done.
+    void migrate_buckets(size_t count) {
+        if (old_iterators_.empty()) {
+            return;
+        }
+        size_t stop = std::min(migrate_position_ + count, old_iterators_.size());
+        for (; migrate_position_ < stop; ++migrate_position_) {
+            if (old_iterators_[migrate_position_] != elements_.end()) {
+                migrate_bucket(migrate_position_);
+            }
+        }
+        if (migrate_position_ == old_iterators_.size()) {
+            old_iterators_.clear();
+            old_iterators_.shrink_to_fit();
+        }
+    }
+
+    void finish_rehash() {
+        migrate_buckets(old_iterators_.size());
+    }
+
+    // Starts moving the elements into twice as many buckets, a few at a time.
+    void start_incremental_rehash() {
+        finish_rehash();
+        VectorType buckets(RehashPolicy::bucket_count(policy_.grown_bucket_count(iterators_.size())),
+                           elements_.end(), ListTypeIterAlloc(alloc_));
+        old_iterators_.swap(iterators_);
+        iterators_.swap(buckets);
+        migrate_position_ = 0;
+        update_thresholds();
+    }
 
 public:
     template <bool IsConst>
@@ -475,7 +908,7 @@ public:
         }
 
         reference operator*() const {
-            return *(position_->key_value);
+            return position_->key_value;
         }
 
         template <bool IsConstOther>
@@ -489,7 +922,7 @@ public:
         }
 
         pointer operator->() const {
-            return position_->key_value;
+            return &position_->key_value;
         }
 
         template <bool IsConstOther>
@@ -520,16 +953,28 @@ public:
     explicit UnorderedMap(size_t bucket_count,
                           const Hash& hash = Hash(),
                           const Equal& equal = Equal(),
-                          const Alloc& alloc = Alloc())
+                          const Alloc& alloc = Alloc(),
+                          const RehashPolicy& policy = RehashPolicy())
         : elements_(ListAlloc(alloc))
-        , iterators_(bucket_count, elements_.end(), ListTypeIterAlloc(alloc))
+        , iterators_(RehashPolicy::bucket_count(bucket_count), elements_.end(),
+                     ListTypeIterAlloc(alloc))
+        , old_iterators_(ListTypeIterAlloc(alloc))
+        , migrate_position_(0)
+        , rehash_step_(0)
         , hash_(hash)
         , equal_(equal)
         , alloc_(alloc)
-        , max_load_factor_(DEFAULT_MAX_LOAD_FACTOR)
-    {}
+        , policy_(policy)
+    {
+        policy_.validate();
+        update_thresholds();
+    }
+
+    UnorderedMap() : UnorderedMap(RehashPolicy()) {}
 
-    UnorderedMap() : UnorderedMap(DEFAULT_BUCKET_COUNT) {}
+    explicit UnorderedMap(const RehashPolicy& policy, const Alloc& alloc = Alloc())
+        : UnorderedMap(policy.initial_bucket_count, Hash(), Equal(), alloc, policy)
+    {}
 
     UnorderedMap(size_t bucket_count, const Alloc& alloc)
         : UnorderedMap(bucket_count, Hash(), Equal(), alloc)
@@ -539,205 +984,2668 @@ public:
         : UnorderedMap(bucket_count, hash, Equal(), alloc)
     {}
 
-    explicit UnorderedMap(const Alloc& alloc)
-        : UnorderedMap(DEFAULT_BUCKET_COUNT, Hash(), Equal(), alloc)
-    {}
+    explicit UnorderedMap(const Alloc& alloc) : UnorderedMap(RehashPolicy(), alloc) {}
 
-    UnorderedMap(const UnorderedMap& other) : UnorderedMap() {
+    UnorderedMap(const UnorderedMap& other) : UnorderedMap(other.policy_) {
         for (auto it = other.elements_.begin(); it != other.elements_.end(); ++it) {
-            emplace(*(it->key_value));
+            emplace(it->key_value);
         }
     }
 
-    UnorderedMap(UnorderedMap&& other)
+    UnorderedMap(UnorderedMap&& other) : UnorderedMap(std::move(other), other.elements_.end()) {}
+
+private:
+    // Empty buckets hold the end of the list they were made for, which is the
+    // sentinel inside the other map; they have to point at ours after a move.
+    void replace_end(ListTypeIter stale_end) {
+        for (VectorType* buckets: {&iterators_, &old_iterators_}) {
+            for (ListTypeIter& iter: *buckets) {
+                if (iter == stale_end) {
+                    iter = elements_.end();
+                }
+            }
+        }
+    }
+
+    UnorderedMap(UnorderedMap&& other, ListTypeIter other_end)
         : elements_(std::move(other.elements_))
         , iterators_(std::move(other.iterators_))
+        , old_iterators_(std::move(other.old_iterators_))
+        , migrate_position_(other.migrate_position_)
+        , rehash_step_(other.rehash_step_)
         , alloc_(traits_t::select_on_container_copy_construction(other.alloc_))
-        , max_load_factor_(std::exchange(other.max_load_factor_,
-                                         DEFAULT_MAX_LOAD_FACTOR))
-    {}
+        , policy_(other.policy_)
+        , grow_at_(other.grow_at_)
+        , shrink_at_(other.shrink_at_)
+    {
+        replace_end(other_end);
+    }
 
+public:
     ~UnorderedMap() {
-        while (elements_.size() > 0) {
-            erase(begin());
-        }
+        clear();
     }
 
     UnorderedMap& operator=(const UnorderedMap& other) {
         if constexpr (traits_t::propagate_on_container_copy_assignment::value) {
             alloc_ = other.alloc_;
         }
-        while (elements_.size() > 0) {
-            erase(begin());
-        }
-        iterators_.resize(DEFAULT_BUCKET_COUNT, elements_.end());
+        clear();
+        finish_rehash();
+        policy_ = other.policy_;
+        iterators_.assign(RehashPolicy::bucket_count(policy_.initial_bucket_count), elements_.end());
+        update_thresholds();
         for (auto it = other.elements_.begin(); it != other.elements_.end(); ++it) {
-            emplace(*(it->key_value));
+            emplace(it->key_value);
         }
-        max_load_factor_ = other.max_load_factor_;
         return *this;
     }
 
     UnorderedMap& operator=(UnorderedMap&& other) {
-        while (elements_.size() > 0) {
-            erase(begin());
-        }
+        clear();
+        ListTypeIter other_end = other.elements_.end();
         elements_ = std::move(other.elements_);
         iterators_ = std::move(other.iterators_);
+        old_iterators_ = std::move(other.old_iterators_);
+        migrate_position_ = other.migrate_position_;
+        rehash_step_ = other.rehash_step_;
         if constexpr (traits_t::propagate_on_container_move_assignment::value) {
             alloc_ = other.alloc_;
         }
-        max_load_factor_ = std::exchange(other.max_load_factor_,
-                                         DEFAULT_MAX_LOAD_FACTOR);
+        policy_ = other.policy_;
+        grow_at_ = other.grow_at_;
+        shrink_at_ = other.shrink_at_;
+        replace_end(other_end);
         return *this;
     }
 
-    Iterator find(const Key& key) {
-        size_t index = hash_(key) % iterators_.size();
-        ListTypeIter iter = iterators_[index];
-        while (iter != elements_.end()
-               && iter->hash % iterators_.size() == index) {
-            if (equal_(iter->key_value->first, key)) {
+private:
+    template <typename K>
+    using EnableIfTransparent = std::enable_if_t<is_transparent_lookup<Hash, Equal>::value, K>;
+
+    template <typename K>
+    ListTypeIter find_node(const K& key, size_t hash) const {
+        if (!old_iterators_.empty()) {
+            size_t index = bucket_index(hash, old_iterators_);
+            ListTypeIter iter = old_iterators_[index];
+            if (iter != elements_.end()) {
+                while (iter != elements_.end()
+                       && bucket_index(iter->hash, old_iterators_) == index) {
+                    if (iter->hash == hash && equal_(iter->key_value.first, key)) {
+                        return iter;
+                    }
+                    ++iter;
+                }
+                return elements_.end();
+            }
+        }
+        size_t index = bucket_index(hash, iterators_);
+        for (ListTypeIter iter = iterators_[index]; in_new_chain(iter, index); ++iter) {
+            if (iter->hash == hash && equal_(iter->key_value.first, key)) {
                 return iter;
             }
-            ++iter;
         }
-        return end();
+        return elements_.end();
     }
 
-    Iterator erase(ConstIterator iter) {
-        size_t index = iter.position_->hash % iterators_.size();
-        traits_t::destroy(alloc_, iter.position_->key_value);
-        traits_t::deallocate(alloc_, iter.position_->key_value, 1);
-        iter.position_->key_value = nullptr;
-        if (iterators_[index] == iter.position_) {
-            iterators_[index] = elements_.erase(iter.position_);
-            ListTypeIter next = iterators_[index];
-            if (next != elements_.end()
-                && next->hash % iterators_.size() != index) {
-                iterators_[index] = elements_.end();
+    // Puts a node whose element and hash are set into its bucket. A new node
+    // always goes to the new table, so its old bucket has to move first.
+    ListTypeIter link_node(ListTypeIter node) {
+        if (!old_iterators_.empty()) {
+            size_t index = bucket_index(node->hash, old_iterators_);
+            if (old_iterators_[index] != elements_.end()) {
+                migrate_bucket(index);
             }
-            return next;
-        }
-        return elements_.erase(iter.position_);
-    }
-    
-    Iterator erase(ConstIterator first, ConstIterator last) {
-        while (first != last) {
-            first = erase(first);
         }
-        return first.position_;
-    }
-
-    void rehash(size_t count) {
-        count = std::max(count, iterators_.size());
-        iterators_.clear();
-        iterators_.resize(count, elements_.end());
-        ListTypeIter current = elements_.begin();
-        while (current != elements_.end()) {
-            ListTypeIter next = ++current;
-            --current;
-            size_t index = current->hash % count;
-            elements_.splice(
-                iterators_[index] == elements_.end() ?
-                elements_.begin() : iterators_[index],
-                current
-            );
-            iterators_[index] = current;
-            current = next;
+        splice_into_bucket(node);
+        if (elements_.size() > grow_at_) {
+            if (rehash_step_ > 0) {
+                start_incremental_rehash();
+            } else {
+                rebuild(RehashPolicy::bucket_count(policy_.grown_bucket_count(iterators_.size())));
+            }
         }
+        migrate_buckets(rehash_step_);
+        return node;
     }
 
+    // Adds an element whose key is known to be missing and to have the given
+    // hash; the lookup that found this out is not repeated.
     template <typename... Args>
-    std::pair<Iterator, bool> emplace(Args&&... args) {
-        NodeType* node = traits_t::allocate(alloc_, 1);
-        try {
-            traits_t::construct(alloc_, node, std::forward<Args>(args)...);
-        } catch (...) {
-            traits_t::deallocate(alloc_, node, 1);
-            throw;
-        }
-        size_t hash;
+    ListTypeIter emplace_new(size_t hash, Args&&... args) {
+        ListTypeIter node = elements_.insert(elements_.begin(), hash);
         try {
-            hash = hash_(node->first);
+            traits_t::construct(alloc_, &node->key_value, std::forward<Args>(args)...);
         } catch (...) {
-            traits_t::destroy(alloc_, node);
-            traits_t::deallocate(alloc_, node, 1);
+            elements_.erase(node);
             throw;
         }
-        Iterator iter = find(node->first);
-        if (iter != end()) {
-            traits_t::destroy(alloc_, node);
-            traits_t::deallocate(alloc_, node, 1);
+        return link_node(node);
+    }
+
+    template <typename K, typename... Args>
+    std::pair<Iterator, bool> try_emplace_key(K&& key, Args&&... args) {
+        size_t hash = hash_of(key);
+        ListTypeIter iter = find_node(key, hash);
+        if (iter != elements_.end()) {
             return {iter, false};
         }
-        size_t index = hash % iterators_.size();
-        iterators_[index] = elements_.insert(
-            iterators_[index] == elements_.end() ?
-            elements_.begin() : iterators_[index],
-            ListNode(node, hash)
-        );
-        iter = iterators_[index];
-        if (load_factor() > max_load_factor_) {
-            rehash(iterators_.size() * 2);
+        return {emplace_new(hash, std::piecewise_construct,
+                            std::forward_as_tuple(std::forward<K>(key)),
+                            std::forward_as_tuple(std::forward<Args>(args)...)), true};
+    }
+
+    template <typename K, typename M>
+    std::pair<Iterator, bool> insert_or_assign_key(K&& key, M&& object) {
+        size_t hash = hash_of(key);
+        ListTypeIter iter = find_node(key, hash);
+        if (iter != elements_.end()) {
+            iter->key_value.second = std::forward<M>(object);
+            return {iter, false};
         }
-        return {iter, true};
+        return {emplace_new(hash, std::forward<K>(key), std::forward<M>(object)), true};
     }
 
-    Value& operator[](const Key& key) {
-        return emplace(key, Value()).first->second;
+public:
+    // With a step of zero, the default, the table is rehashed all at once when
+    // it grows, which stalls the insert that triggers it for as long as it takes
+    // to walk every element. Otherwise the old buckets are kept, lookups and
+    // erasures consult both tables, and every insert moves `buckets` old buckets
+    // into the new one, so that no insert walks more than a few chains. Only
+    // inserts move elements, as before, so the iteration order is never changed
+    // by a lookup or an erasure. A step of 2 or more finishes the move before the
+    // table has to grow again.
+    void set_rehash_step(size_t buckets) {
+        rehash_step_ = buckets;
+        if (rehash_step_ == 0) {
+            finish_rehash();
+        }
     }
 
-    Value& operator[](Key&& key) {
-        return emplace(std::forward<Key>(key), Value()).first->second;
+    Iterator find(const Key& key) {
+        return find_node(key, hash_of(key));
     }
 
-    Value& at(const Key& key) {
-        Iterator iter = find(key);
-        if (iter == end()) {
-            throw std::out_of_range("Out of range");
-        }
-        return iter->second;
+    ConstIterator find(const Key& key) const {
+        return find_node(key, hash_of(key));
     }
 
-    const Value& at(const Key& key) const {
-        return (*const_cast<const UnorderedMap*>(this)).at(key);
+    template <typename K, typename = EnableIfTransparent<K> >
+    Iterator find(const K& key) {
+        return find_node(key, hash_of(key));
     }
 
-    size_t size() const {
-        return elements_.size();
+    template <typename K, typename = EnableIfTransparent<K> >
+    ConstIterator find(const K& key) const {
+        return find_node(key, hash_of(key));
     }
 
-    std::pair<Iterator, bool> insert(const NodeType& node) {
-        return emplace(node);
+    bool contains(const Key& key) const {
+        return find_node(key, hash_of(key)) != elements_.end();
     }
 
-    std::pair<Iterator, bool> insert(NodeType&& node) {
-        return emplace(std::move(const_cast<Key&>(node.first)), std::move(node.second));
+    template <typename K, typename = EnableIfTransparent<K> >
+    bool contains(const K& key) const {
+        return find_node(key, hash_of(key)) != elements_.end();
     }
 
-    template <typename InputIter>
-    void insert(InputIter first, InputIter last) {
+private:
+    static constexpr size_t BATCH_SIZE = 16;
+
+    // Looks keys up BATCH_SIZE at a time in three passes: hash every key and
+    // prefetch its bucket, then read the buckets and prefetch the first node of
+    // each chain, then walk the chains. The cache misses of one pass overlap
+    // instead of being taken one after another, as they are in a loop of finds.
+    template <typename KeyIter, typename OutIter, typename Convert>
+    OutIter lookup_batch(KeyIter first, KeyIter last, OutIter out, Convert convert) const {
+        const Key* keys[BATCH_SIZE];
+        size_t hashes[BATCH_SIZE];
+        size_t indices[BATCH_SIZE];
         while (first != last) {
-            insert(*first++);
+            size_t count = 0;
+            for (; count < BATCH_SIZE && first != last; ++count, ++first) {
+                keys[count] = &*first;
+                hashes[count] = hash_of(*keys[count]);
+                indices[count] = bucket_index(hashes[count], iterators_);
+                prefetch(&iterators_[indices[count]]);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                ListTypeIter head = iterators_[indices[i]];
+                if (head != elements_.end()) {
+                    prefetch(&*head);
+                }
+            }
+            for (size_t i = 0; i < count; ++i) {
+                *out++ = convert(find_node(*keys[i], hashes[i]));
+            }
         }
+        return out;
     }
 
-    void reserve(size_t count) {
-        rehash(count);
+public:
+    // Writes find(key) for every key in [first, last) to out. Worth it for
+    // maps that don't fit in cache; keys must be stored in a container, since
+    // the batch keeps pointers to them.
+    template <typename KeyIter, typename OutIter>
+    OutIter find_batch(KeyIter first, KeyIter last, OutIter out) {
+        return lookup_batch(first, last, out, [](ListTypeIter node) { return Iterator(node); });
     }
 
-    size_t max_size() const {
-        return 100000000;
+    template <typename KeyIter, typename OutIter>
+    OutIter contains_batch(KeyIter first, KeyIter last, OutIter out) const {
+        return lookup_batch(first, last, out, [this](ListTypeIter node) {
+            return node != elements_.end();
+        });
     }
 
-    double load_factor() const {
-        return static_cast<double>(elements_.size()) /
-               static_cast<double>(iterators_.size());
+private:
+    ListTypeIter unlink_and_destroy(ListTypeIter node) {
+        ListTypeIter next = node;
+        ++next;
+        if (in_old_table(node)) {
+            size_t index = bucket_index(node->hash, old_iterators_);
+            if (old_iterators_[index] == node) {
+                bool same_chain = next != elements_.end()
+                                  && bucket_index(next->hash, old_iterators_) == index;
+                old_iterators_[index] = same_chain ? next : elements_.end();
+            }
+        } else {
+            size_t index = bucket_index(node->hash, iterators_);
+            if (iterators_[index] == node) {
+                iterators_[index] = in_new_chain(next, index) ? next : elements_.end();
+            }
+        }
+        traits_t::destroy(alloc_, &node->key_value);
+        elements_.erase(node);
+        return next;
     }
 
-    double max_load_factor() const {
-        return max_load_factor_;
+    // Shrinks the table after erasures if the policy asks for it. Nodes stay
+    // where they are, but the iteration order changes, as after an insert.
+    void shrink_if_sparse() {
+        if (elements_.size() >= shrink_at_) {
+            return;
+        }
+        size_t count = std::max(policy_.grown_bucket_count(policy_.buckets_for(elements_.size())),
+                                policy_.initial_bucket_count);
+        count = RehashPolicy::bucket_count(count);
+        if (count < iterators_.size()) {
+            rebuild(count);
+        }
+    }
+
+    // Redistributes all elements over count buckets, which must be a count
+    // the policy allows.
+    void rebuild(size_t count) {
+        finish_rehash();
+        iterators_.clear();
+        iterators_.resize(count, elements_.end());
+        ListTypeIter current = elements_.begin();
+        while (current != elements_.end()) {
+            ListTypeIter next = ++current;
+            --current;
+            size_t index = RehashPolicy::index(current->hash, count);
+            elements_.splice(
+                iterators_[index] == elements_.end() ?
+                elements_.begin() : iterators_[index],
+                current
+            );
+            iterators_[index] = current;
+            current = next;
+        }
+        update_thresholds();
+    }
+
+public:
+    // With shrinking enabled in the policy, an erase may rehash. Erasing while
+    // iterating then has to restart from begin() rather than continue from the
+    // returned iterator.
+    Iterator erase(ConstIterator iter) {
+        ListTypeIter next = unlink_and_destroy(iter.position_);
+        shrink_if_sparse();
+        return next;
+    }
+
+    Iterator erase(ConstIterator first, ConstIterator last) {
+        while (first != last) {
+            first = ConstIterator(unlink_and_destroy(first.position_));
+        }
+        shrink_if_sparse();
+        return first.position_;
+    }
+
+    void clear() {
+        while (elements_.size() > 0) {
+            unlink_and_destroy(elements_.begin());
+        }
+    }
+
+    // Sets the bucket count to at least count, and to at least enough for the
+    // current elements; it may be lower than the current one.
+    void rehash(size_t count) {
+        rebuild(rehash_bucket_count(count));
+    }
+
+    // Same as rehash, with the elements sorted into their buckets by up to
+    // `threads` threads; zero means one per hardware thread. Hash and Equal are
+    // called from all of them at once.
+    void rehash_parallel(size_t count, size_t threads = 0) {
+        relink_parallel(rehash_bucket_count(count), threads, static_cast<const NodeType*>(nullptr), 0);
+    }
+
+    // Inserts [first, last) like insert(first, last), but builds the table in
+    // one go: it is sized for all of the new elements up front, the keys are
+    // hashed and sorted into their buckets by up to `threads` threads, and each
+    // thread links the buckets of its own range, so no locks are taken. Nodes are
+    // still allocated and constructed on the calling thread, as the allocator
+    // need not be thread-safe. The iteration order of the elements that were
+    // already there may change, as after any rehash.
+    template <typename InputIter>
+    void insert_parallel(InputIter first, InputIter last, size_t threads = 0) {
+        if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+                      typename std::iterator_traits<InputIter>::iterator_category>) {
+            size_t count = static_cast<size_t>(last - first);
+            size_t buckets = RehashPolicy::bucket_count(
+                std::max(policy_.buckets_for(elements_.size() + count), iterators_.size()));
+            relink_parallel(buckets, threads, first, count);
+        } else {
+            insert(first, last);
+        }
+    }
+
+private:
+    size_t rehash_bucket_count(size_t count) const {
+        count = std::max(count, policy_.buckets_for(elements_.size()));
+        return RehashPolicy::bucket_count(std::max<size_t>(count, 1));
+    }
+
+    // The elements, old and new, are numbered: first the m nodes already in the
+    // list, then the n new pairs first[0], ..., first[n - 1]. They are counted
+    // and scattered by range of buckets, one range per thread, and each thread
+    // then sorts its range by bucket and drops the new keys already seen in
+    // their bucket. Numbering keeps every sort stable, so an existing element
+    // always wins over a new one, and an earlier pair over a later one.
+    // Lists the nodes with their hashes, each thread walking the chains of a
+    // range of buckets. The nodes are scattered over the heap, so a walk is
+    // mostly cache misses; this is the only one, and the nodes are touched once
+    // more when they are linked.
+    void collect_nodes(size_t threads, std::vector<ListTypeIter>& nodes,
+                       std::vector<size_t>& hashes) const {
+        size_t count = iterators_.size();
+        std::vector<std::vector<std::pair<ListTypeIter, size_t> > > found(threads);
+        run_in_parallel(threads, [&](size_t part) {
+            for (size_t bucket = part * count / threads; bucket < (part + 1) * count / threads;
+                 ++bucket) {
+                for (ListTypeIter iter = iterators_[bucket]; in_new_chain(iter, bucket); ++iter) {
+                    found[part].emplace_back(iter, iter->hash);
+                }
+            }
+        });
+        std::vector<size_t> offsets(threads + 1);
+        for (size_t part = 0; part < threads; ++part) {
+            offsets[part + 1] = offsets[part] + found[part].size();
+        }
+        run_in_parallel(threads, [&](size_t part) {
+            for (size_t i = 0; i < found[part].size(); ++i) {
+                nodes[offsets[part] + i] = found[part][i].first;
+                hashes[offsets[part] + i] = found[part][i].second;
+            }
+        });
+    }
+
+    template <typename RandomIter>
+    void relink_parallel(size_t count, size_t threads, RandomIter first, size_t n) {
+        finish_rehash();
+        size_t m = elements_.size();
+        size_t total = m + n;
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        // Spawning a thread only pays off with a few thousand elements for it.
+        threads = std::max<size_t>(std::min(threads, total / 4096), 1);
+        threads = std::min(threads, count);
+
+        if (n == 0 && threads == 1) {
+            rebuild(count);
+            return;
+        }
+
+        std::vector<ListTypeIter> node_of(total, elements_.end());
+        std::vector<size_t> hashes(total);
+        collect_nodes(threads, node_of, hashes);
+        auto range_begin = [&](size_t part) { return (part * count + threads - 1) / threads; };
+        auto part_of = [&](size_t bucket) { return bucket * threads / count; };
+        auto chunk_begin = [&](size_t chunk) { return chunk * total / threads; };
+
+        std::vector<size_t> buckets(total);
+        std::vector<size_t> offsets(threads * threads);
+        run_in_parallel(threads, [&](size_t chunk) {
+            for (size_t id = chunk_begin(chunk); id < chunk_begin(chunk + 1); ++id) {
+                if (id >= m) {
+                    hashes[id] = hash_of(first[id - m].first);
+                }
+                buckets[id] = RehashPolicy::index(hashes[id], count);
+                ++offsets[chunk * threads + part_of(buckets[id])];
+            }
+        });
+        std::vector<size_t> part_begin(threads + 1);
+        for (size_t part = 0, position = 0; part < threads; ++part) {
+            part_begin[part] = position;
+            for (size_t chunk = 0; chunk < threads; ++chunk) {
+                position += std::exchange(offsets[chunk * threads + part], position);
+            }
+        }
+        part_begin[threads] = total;
+
+        std::vector<size_t> grouped(total);
+        run_in_parallel(threads, [&](size_t chunk) {
+            size_t* offset = &offsets[chunk * threads];
+            for (size_t id = chunk_begin(chunk); id < chunk_begin(chunk + 1); ++id) {
+                grouped[offset[part_of(buckets[id])]++] = id;
+            }
+        });
+
+        std::vector<size_t> sorted(total);
+        std::vector<size_t> bucket_begin(count + 1);
+        bucket_begin[count] = total;
+        std::vector<size_t> kept(threads);
+        std::vector<char> keep(total, 1);
+        run_in_parallel(threads, [&](size_t part) {
+            size_t low = range_begin(part);
+            size_t high = range_begin(part + 1);
+            std::vector<size_t> starts(high - low + 1);
+            for (size_t i = part_begin[part]; i < part_begin[part + 1]; ++i) {
+                ++starts[buckets[grouped[i]] - low + 1];
+            }
+            starts[0] = part_begin[part];
+            for (size_t bucket = 0; bucket < high - low; ++bucket) {
+                starts[bucket + 1] += starts[bucket];
+            }
+            std::copy(starts.begin(), starts.end() - 1, bucket_begin.begin() + low);
+            std::vector<size_t> position(starts.begin(), starts.end() - 1);
+            for (size_t i = part_begin[part]; i < part_begin[part + 1]; ++i) {
+                sorted[position[buckets[grouped[i]] - low]++] = grouped[i];
+            }
+            if (n == 0) {
+                kept[part] = part_begin[part + 1] - part_begin[part];
+                return;
+            }
+            auto key_of = [&](size_t id) -> decltype(auto) {
+                return id < m ? node_of[id]->key_value.first : first[id - m].first;
+            };
+            // Each new id is only compared with the ids kept so far in its
+            // bucket, so a run of duplicates costs one comparison per copy.
+            std::vector<size_t> bucket_kept;
+            for (size_t bucket = 0; bucket < high - low; ++bucket) {
+                bucket_kept.clear();
+                for (size_t i = starts[bucket]; i < starts[bucket + 1]; ++i) {
+                    size_t id = sorted[i];
+                    for (size_t j = 0; id >= m && j < bucket_kept.size(); ++j) {
+                        size_t other = bucket_kept[j];
+                        if (hashes[other] == hashes[id] && equal_(key_of(other), key_of(id))) {
+                            keep[id] = 0;
+                            break;
+                        }
+                    }
+                    if (keep[id]) {
+                        bucket_kept.push_back(id);
+                        ++kept[part];
+                    }
+                }
+            }
+        });
+
+        VectorType new_buckets(count, elements_.end(), ListTypeIterAlloc(alloc_));
+        for (size_t id = m; id < total; ++id) {
+            if (!keep[id]) {
+                continue;
+            }
+            try {
+                node_of[id] = elements_.insert(elements_.begin(), hashes[id]);
+                try {
+                    traits_t::construct(alloc_, &node_of[id]->key_value, first[id - m]);
+                } catch (...) {
+                    elements_.erase(node_of[id]);
+                    throw;
+                }
+            } catch (...) {
+                while (id-- > m) {
+                    if (keep[id]) {
+                        traits_t::destroy(alloc_, &node_of[id]->key_value);
+                        elements_.erase(node_of[id]);
+                    }
+                }
+                throw;
+            }
+        }
+
+        std::vector<ListTypeIter> order(elements_.size(), elements_.end());
+        std::vector<size_t> order_begin(threads + 1);
+        for (size_t part = 0; part < threads; ++part) {
+            order_begin[part + 1] = order_begin[part] + kept[part];
+        }
+        run_in_parallel(threads, [&](size_t part) {
+            size_t position = order_begin[part];
+            for (size_t bucket = range_begin(part); bucket < range_begin(part + 1); ++bucket) {
+                for (size_t i = bucket_begin[bucket]; i < bucket_begin[bucket + 1]; ++i) {
+                    if (keep[sorted[i]]) {
+                        if (new_buckets[bucket] == elements_.end()) {
+                            new_buckets[bucket] = node_of[sorted[i]];
+                        }
+                        order[position++] = node_of[sorted[i]];
+                    }
+                }
+            }
+        });
+        run_in_parallel(threads, [&](size_t part) {
+            elements_.link_in_order(order.data(), order_begin[part], order_begin[part + 1]);
+        });
+        iterators_.swap(new_buckets);
+        update_thresholds();
+    }
+
+public:
+
+    // The key is only known once the element is built, so the element is built
+    // in a node at the front of the list, where no bucket's chain can reach it,
+    // and spliced into its bucket if the key turns out to be new. try_emplace
+    // avoids building anything when the key is already there.
+    template <typename... Args>
+    std::pair<Iterator, bool> emplace(Args&&... args) {
+        ListTypeIter node = elements_.insert(elements_.begin(), size_t(0));
+        try {
+            traits_t::construct(alloc_, &node->key_value, std::forward<Args>(args)...);
+        } catch (...) {
+            elements_.erase(node);
+            throw;
+        }
+        try {
+            node->hash = hash_of(node->key_value.first);
+        } catch (...) {
+            traits_t::destroy(alloc_, &node->key_value);
+            elements_.erase(node);
+            throw;
+        }
+        ListTypeIter iter = find_node(node->key_value.first, node->hash);
+        if (iter != elements_.end()) {
+            traits_t::destroy(alloc_, &node->key_value);
+            elements_.erase(node);
+            return {iter, false};
+        }
+        return {link_node(node), true};
+    }
+
+    // Constructs the value from args only if key is missing; otherwise neither
+    // key nor args are touched.
+    template <typename... Args>
+    std::pair<Iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        return try_emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<Iterator, bool> try_emplace(Key&& key, Args&&... args) {
+        return try_emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename M>
+    std::pair<Iterator, bool> insert_or_assign(const Key& key, M&& object) {
+        return insert_or_assign_key(key, std::forward<M>(object));
+    }
+
+    template <typename M>
+    std::pair<Iterator, bool> insert_or_assign(Key&& key, M&& object) {
+        return insert_or_assign_key(std::move(key), std::forward<M>(object));
+    }
+
+    Value& operator[](const Key& key) {
+        return try_emplace_key(key).first->second;
+    }
+
+    Value& operator[](Key&& key) {
+        return try_emplace_key(std::move(key)).first->second;
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    Value& operator[](K&& key) {
+        return try_emplace_key(std::forward<K>(key)).first->second;
+    }
+
+    Value& at(const Key& key) {
+        Iterator iter = find(key);
+        if (iter == end()) {
+            throw std::out_of_range("Out of range");
+        }
+        return iter->second;
+    }
+
+    const Value& at(const Key& key) const {
+        ConstIterator iter = find(key);
+        if (iter == ConstIterator(elements_.end())) {
+            throw std::out_of_range("Out of range");
+        }
+        return iter->second;
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    Value& at(const K& key) {
+        Iterator iter = find(key);
+        if (iter == end()) {
+            throw std::out_of_range("Out of range");
+        }
+        return iter->second;
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    const Value& at(const K& key) const {
+        ConstIterator iter = find(key);
+        if (iter == ConstIterator(elements_.end())) {
+            throw std::out_of_range("Out of range");
+        }
+        return iter->second;
+    }
+
+    size_t size() const {
+        return elements_.size();
+    }
+
+    std::pair<Iterator, bool> insert(const NodeType& node) {
+        return emplace(node);
+    }
+
+    std::pair<Iterator, bool> insert(NodeType&& node) {
+        return emplace(std::move(const_cast<Key&>(node.first)), std::move(node.second));
+    }
+
+    // A range that can be measured is made room for up front, so that the
+    // table grows at most once.
+    template <typename InputIter>
+    void insert(InputIter first, InputIter last) {
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                      typename std::iterator_traits<InputIter>::iterator_category>) {
+            reserve(elements_.size() + static_cast<size_t>(std::distance(first, last)));
+        }
+        while (first != last) {
+            insert(*first++);
+        }
+    }
+
+    // Makes room for count elements without growing. Never shrinks.
+    void reserve(size_t count) {
+        size_t buckets = policy_.buckets_for(count);
+        if (buckets > iterators_.size()) {
+            rehash(buckets);
+        }
+    }
+
+    // Limited both by the node allocator and by how many elements the largest
+    // bucket array may hold.
+    size_t max_size() const {
+        auto node_allocator = elements_.get_allocator();
+        size_t nodes = std::allocator_traits<decltype(node_allocator)>::max_size(node_allocator);
+        double buckets = static_cast<double>(iterators_.max_size()) * policy_.max_load_factor;
+        return buckets < static_cast<double>(nodes) ? static_cast<size_t>(buckets) : nodes;
+    }
+
+    size_t bucket_count() const {
+        return iterators_.size();
+    }
+
+    double load_factor() const {
+        return static_cast<double>(elements_.size()) /
+               static_cast<double>(iterators_.size());
+    }
+
+    double max_load_factor() const {
+        return policy_.max_load_factor;
+    }
+
+    void max_load_factor(double factor) {
+        RehashPolicy policy = policy_;
+        policy.max_load_factor = factor;
+        set_rehash_policy(policy);
+    }
+
+    const RehashPolicy& rehash_policy() const {
+        return policy_;
+    }
+
+    // Rehashes right away if the map is over the new limits.
+    void set_rehash_policy(const RehashPolicy& policy) {
+        policy.validate();
+        policy_ = policy;
+        update_thresholds();
+        if (elements_.size() > grow_at_) {
+            rehash(0);
+        } else {
+            shrink_if_sparse();
+        }
+    }
+};
+
+// Open-addressing engine for UnorderedMap<..., SwissLayout>, after Abseil's
+// flat_hash_map. One control byte per slot says whether the slot is empty,
+// deleted or full, and in the last case holds 7 bits of the hash (h2). A lookup
+// loads a group of 16 control bytes and compares all of them with h2 in one SSE2
+// instruction (8 bytes with plain integer arithmetic elsewhere), so it usually
+// touches one group of control bytes and one slot. Elements live inline in the
+// slot array: there is no per-element allocation and no pointer chasing.
+//
+// The price is stability: a rehash moves the elements, so it invalidates
+// iterators, pointers and references, and so may any insertion that grows the
+// table. Erasure leaves a tombstone, which is cleaned up by the next rehash.
+template <
+    typename Key,
+    typename Value,
+    typename Hash = std::hash<Key>,
+    typename Equal = std::equal_to<Key>,
+    typename Alloc = std::allocator<std::pair<const Key, Value> >
+>
+class SwissTable {
+public:
+    using NodeType = std::pair<const Key, Value>;
+
+private:
+    using ctrl_t = int8_t;
+
+    template <typename K>
+    using EnableIfTransparent = std::enable_if_t<is_transparent_lookup<Hash, Equal>::value, K>;
+
+    static constexpr ctrl_t EMPTY = -128;
+    static constexpr ctrl_t DELETED = -2;
+    static constexpr ctrl_t SENTINEL = -1;
+
+#if defined(__SSE2__)
+    struct Group {
+        static constexpr size_t WIDTH = 16;
+        static constexpr size_t SHIFT = 0;
+
+        __m128i ctrl;
+
+        explicit Group(const ctrl_t* position)
+            : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(position))) {}
+
+        uint64_t match(ctrl_t h2) const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+        }
+
+        uint64_t match_empty() const {
+            return match(EMPTY);
+        }
+
+        uint64_t match_empty_or_deleted() const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(SENTINEL), ctrl)));
+        }
+    };
+#else
+    // Eight control bytes in a word; a match sets the top bit of the byte.
+    struct Group {
+        static constexpr size_t WIDTH = 8;
+        static constexpr size_t SHIFT = 3;
+        static constexpr uint64_t LSBS = 0x0101010101010101ULL;
+        static constexpr uint64_t MSBS = 0x8080808080808080ULL;
+
+        uint64_t ctrl;
+
+        explicit Group(const ctrl_t* position) {
+            std::memcpy(&ctrl, position, sizeof(ctrl));
+        }
+
+        // May report a false positive right after a true one, which the key
+        // comparison filters out.
+        uint64_t match(ctrl_t h2) const {
+            uint64_t x = ctrl ^ (LSBS * static_cast<uint8_t>(h2));
+            return (x - LSBS) & ~x & MSBS;
+        }
+
+        uint64_t match_empty() const {
+            return ctrl & ~(ctrl << 6) & MSBS;
+        }
+
+        uint64_t match_empty_or_deleted() const {
+            return ctrl & ~(ctrl << 7) & MSBS;
+        }
+    };
+#endif
+
+    static constexpr size_t CLONED_BYTES = Group::WIDTH - 1;
+    static constexpr size_t MIN_CAPACITY = 15;
+
+    static size_t lowest(uint64_t mask) {
+        return static_cast<size_t>(__builtin_ctzll(mask)) >> Group::SHIFT;
+    }
+
+    // A slot holds a NodeType. It is constructed and destroyed as one, so a
+    // custom Alloc::construct sees the type it expects, but moved between slots
+    // as a pair of non-const key and value, since the key can't be moved out of
+    // a pair<const Key, Value>.
+    using MutableNode = std::pair<Key, Value>;
+
+    union Slot {
+        NodeType value;
+        MutableNode mutable_value;
+
+        Slot() {}
+
+        ~Slot() {}
+    };
+
+    using traits_t = std::allocator_traits<Alloc>;
+    using MutableAlloc = typename traits_t::template rebind_alloc<MutableNode>;
+    using mutable_traits_t = std::allocator_traits<MutableAlloc>;
+    using SlotAlloc = typename traits_t::template rebind_alloc<Slot>;
+    using slot_traits_t = std::allocator_traits<SlotAlloc>;
+    using CtrlAlloc = typename traits_t::template rebind_alloc<ctrl_t>;
+    using ctrl_traits_t = std::allocator_traits<CtrlAlloc>;
+
+    ctrl_t* ctrl_;
+    Slot* slots_;
+    size_t capacity_;
+    size_t size_;
+    size_t growth_left_;
+
+    Hash hash_;
+    Equal equal_;
+    Alloc alloc_;
+
+    // Control bytes of a table with no slots: a sentinel, so that iteration
+    // stops at once, followed by a group of empties, so that lookups do too.
+    static ctrl_t* empty_group() {
+        alignas(16) static ctrl_t group[17] = {
+            SENTINEL, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+            EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY
+        };
+        return group;
+    }
+
+    static size_t ctrl_bytes(size_t capacity) {
+        return capacity + 1 + CLONED_BYTES;
+    }
+
+    static size_t max_growth(size_t capacity) {
+        return capacity - capacity / 8;
+    }
+
+    // Smallest capacity of the form 2^k - 1 that holds count elements.
+    static size_t capacity_for(size_t count) {
+        size_t capacity = MIN_CAPACITY;
+        while (max_growth(capacity) < count) {
+            capacity = capacity * 2 + 1;
+        }
+        return capacity;
+    }
+
+    static size_t h1(size_t hash) {
+        return hash >> 7;
+    }
+
+    static ctrl_t h2(size_t hash) {
+        return static_cast<ctrl_t>(hash & 0x7F);
+    }
+
+    template <typename K>
+    size_t hash_of(const K& key) const {
+        return mix_hash(hash_(key));
+    }
+
+    // The first CLONED_BYTES control bytes are mirrored after the sentinel, so
+    // that a group loaded near the end of the table wraps around.
+    void set_ctrl(size_t index, ctrl_t value) {
+        ctrl_[index] = value;
+        ctrl_[((index - CLONED_BYTES) & capacity_) + (CLONED_BYTES & capacity_)] = value;
+    }
+
+    template <typename K>
+    size_t find_index(const K& key, size_t hash) const {
+        size_t offset = h1(hash) & capacity_;
+        size_t step = 0;
+        while (true) {
+            Group group(ctrl_ + offset);
+            for (uint64_t mask = group.match(h2(hash)); mask != 0; mask &= mask - 1) {
+                size_t index = (offset + lowest(mask)) & capacity_;
+                if (equal_(slots_[index].value.first, key)) {
+                    return index;
+                }
+            }
+            if (group.match_empty() != 0) {
+                return capacity_;
+            }
+            step += Group::WIDTH;
+            offset = (offset + step) & capacity_;
+        }
+    }
+
+    size_t find_first_non_full(size_t hash) const {
+        size_t offset = h1(hash) & capacity_;
+        size_t step = 0;
+        while (true) {
+            uint64_t mask = Group(ctrl_ + offset).match_empty_or_deleted();
+            if (mask != 0) {
+                return (offset + lowest(mask)) & capacity_;
+            }
+            step += Group::WIDTH;
+            offset = (offset + step) & capacity_;
+        }
+    }
+
+    void relocate(Slot* to, Slot* from) {
+        MutableAlloc mutable_alloc(alloc_);
+        mutable_traits_t::construct(mutable_alloc, &to->mutable_value, std::move(from->mutable_value));
+        traits_t::destroy(alloc_, &from->value);
+    }
+
+    void deallocate_table() {
+        if (capacity_ == 0) {
+            return;
+        }
+        CtrlAlloc ctrl_alloc(alloc_);
+        SlotAlloc slot_alloc(alloc_);
+        ctrl_traits_t::deallocate(ctrl_alloc, ctrl_, ctrl_bytes(capacity_));
+        slot_traits_t::deallocate(slot_alloc, slots_, capacity_);
+    }
+
+    void destroy_elements() {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0) {
+                traits_t::destroy(alloc_, &slots_[i].value);
+            }
+        }
+    }
+
+    void reset() {
+        ctrl_ = empty_group();
+        slots_ = nullptr;
+        capacity_ = 0;
+        size_ = 0;
+        growth_left_ = 0;
+    }
+
+    // Moves every element into a fresh table of new_capacity slots, which
+    // also drops all tombstones. The old arrays are kept until every element
+    // has its place in the new ones, so if the hash or a copy throws, the new
+    // arrays are released and the table is left as it was. Elements are moved
+    // when their move can't throw (or they can't be copied), and a hash that
+    // throws halfway would then strand moved-from elements, so the hashes are
+    // computed first. A move-only element whose move throws is lost, as in
+    // std::vector.
+    void resize(size_t new_capacity) {
+        constexpr bool PRECOMPUTE_HASHES = !std::is_nothrow_invocable_v<const Hash&, const Key&>
+            && (std::is_nothrow_move_constructible_v<MutableNode>
+                || !std::is_copy_constructible_v<MutableNode>);
+        std::vector<size_t> hashes;
+        if constexpr (PRECOMPUTE_HASHES) {
+            hashes.reserve(size_);
+            for (size_t i = 0; i < capacity_; ++i) {
+                if (ctrl_[i] >= 0) {
+                    hashes.push_back(hash_of(slots_[i].value.first));
+                }
+            }
+        }
+
+        CtrlAlloc ctrl_alloc(alloc_);
+        SlotAlloc slot_alloc(alloc_);
+        ctrl_t* new_ctrl = ctrl_traits_t::allocate(ctrl_alloc, ctrl_bytes(new_capacity));
+        Slot* new_slots;
+        try {
+            new_slots = slot_traits_t::allocate(slot_alloc, new_capacity);
+        } catch (...) {
+            ctrl_traits_t::deallocate(ctrl_alloc, new_ctrl, ctrl_bytes(new_capacity));
+            throw;
+        }
+        std::fill(new_ctrl, new_ctrl + ctrl_bytes(new_capacity), EMPTY);
+        new_ctrl[new_capacity] = SENTINEL;
+
+        ctrl_t* old_ctrl = std::exchange(ctrl_, new_ctrl);
+        Slot* old_slots = std::exchange(slots_, new_slots);
+        size_t old_capacity = std::exchange(capacity_, new_capacity);
+        MutableAlloc mutable_alloc(alloc_);
+        try {
+            size_t next_hash = 0;
+            for (size_t i = 0; i < old_capacity; ++i) {
+                if (old_ctrl[i] >= 0) {
+                    size_t hash;
+                    if constexpr (PRECOMPUTE_HASHES) {
+                        hash = hashes[next_hash++];
+                    } else {
+                        hash = hash_of(old_slots[i].value.first);
+                    }
+                    size_t index = find_first_non_full(hash);
+                    mutable_traits_t::construct(mutable_alloc, &slots_[index].mutable_value,
+                                                std::move_if_noexcept(old_slots[i].mutable_value));
+                    set_ctrl(index, h2(hash));
+                }
+            }
+        } catch (...) {
+            destroy_elements();
+            deallocate_table();
+            ctrl_ = old_ctrl;
+            slots_ = old_slots;
+            capacity_ = old_capacity;
+            throw;
+        }
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old_ctrl[i] >= 0) {
+                traits_t::destroy(alloc_, &old_slots[i].value);
+            }
+        }
+        growth_left_ = max_growth(capacity_) - size_;
+        if (old_capacity != 0) {
+            ctrl_traits_t::deallocate(ctrl_alloc, old_ctrl, ctrl_bytes(old_capacity));
+            slot_traits_t::deallocate(slot_alloc, old_slots, old_capacity);
+        }
+    }
+
+    // Finds a slot for a new element with the given hash, growing the table or
+    // squeezing out its tombstones first if it is full.
+    size_t prepare_insert(size_t hash) {
+        if (growth_left_ == 0) {
+            if (capacity_ != 0 && size_ <= max_growth(capacity_) / 2) {
+                resize(capacity_);
+            } else {
+                resize(capacity_ == 0 ? MIN_CAPACITY : capacity_ * 2 + 1);
+            }
+        }
+        size_t index = find_first_non_full(hash);
+        if (ctrl_[index] == EMPTY) {
+            --growth_left_;
+        }
+        set_ctrl(index, h2(hash));
+        ++size_;
+        return index;
+    }
+
+    // Undoes prepare_insert when constructing the element threw.
+    void abandon_insert(size_t index) {
+        set_ctrl(index, DELETED);
+        --size_;
+    }
+
+    // Constructs the element from args only if key is missing.
+    template <typename K, typename... Args>
+    std::pair<size_t, bool> emplace_key(const K& key, Args&&... args) {
+        size_t hash = hash_of(key);
+        size_t index = find_index(key, hash);
+        if (index != capacity_) {
+            return {index, false};
+        }
+        index = prepare_insert(hash);
+        try {
+            traits_t::construct(alloc_, &slots_[index].value, std::forward<Args>(args)...);
+        } catch (...) {
+            abandon_insert(index);
+            throw;
+        }
+        return {index, true};
+    }
+
+    void copy_from(const SwissTable& other) {
+        if (other.size_ == 0) {
+            return;
+        }
+        resize(capacity_for(other.size_));
+        for (size_t i = 0; i < other.capacity_; ++i) {
+            if (other.ctrl_[i] >= 0) {
+                size_t index = prepare_insert(hash_of(other.slots_[i].value.first));
+                try {
+                    traits_t::construct(alloc_, &slots_[index].value, other.slots_[i].value);
+                } catch (...) {
+                    abandon_insert(index);
+                    throw;
+                }
+            }
+        }
+    }
+
+    void take_table(SwissTable& other) noexcept {
+        ctrl_ = other.ctrl_;
+        slots_ = other.slots_;
+        capacity_ = other.capacity_;
+        size_ = other.size_;
+        growth_left_ = other.growth_left_;
+        other.reset();
+    }
+
+public:
+    template <bool IsConst>
+    class CommonIterator {
+    private:
+        ctrl_t* ctrl_;
+        Slot* slot_;
+
+        void skip_empty_or_deleted() {
+            while (*ctrl_ < SENTINEL) {
+                ++ctrl_;
+                ++slot_;
+            }
+        }
+
+    public:
+        using value_type = std::conditional_t<IsConst, const NodeType, NodeType>;
+        using pointer = std::conditional_t<IsConst, const NodeType*, NodeType*>;
+        using reference = std::conditional_t<IsConst, const NodeType&, NodeType&>;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        CommonIterator(ctrl_t* ctrl, Slot* slot) : ctrl_(ctrl), slot_(slot) {}
+
+        CommonIterator(const CommonIterator<false>& other)
+            : ctrl_(other.ctrl_), slot_(other.slot_) {}
+
+        CommonIterator& operator=(const CommonIterator<false>& other) {
+            ctrl_ = other.ctrl_;
+            slot_ = other.slot_;
+            return *this;
+        }
+
+        ~CommonIterator() = default;
+
+        CommonIterator& operator++() {
+            ++ctrl_;
+            ++slot_;
+            skip_empty_or_deleted();
+            return *this;
+        }
+
+        CommonIterator operator++(int) {
+            CommonIterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        reference operator*() const {
+            return slot_->value;
+        }
+
+        pointer operator->() const {
+            return &slot_->value;
+        }
+
+        template <bool IsConstOther>
+        bool operator==(CommonIterator<IsConstOther> other) const {
+            return ctrl_ == other.ctrl_;
+        }
+
+        template <bool IsConstOther>
+        bool operator!=(CommonIterator<IsConstOther> other) const {
+            return !(*this == other);
+        }
+
+        template <bool IsConstOther>
+        friend class CommonIterator;
+
+        friend class SwissTable;
+    };
+
+    using Iterator = CommonIterator<false>;
+    using ConstIterator = CommonIterator<true>;
+
+private:
+    Iterator iterator_at(size_t index) const {
+        return Iterator(ctrl_ + index, slots_ + index);
+    }
+
+    template <typename K, typename... Args>
+    std::pair<Iterator, bool> try_emplace_key(K&& key, Args&&... args) {
+        auto [index, inserted] = emplace_key(key, std::piecewise_construct,
+                                             std::forward_as_tuple(std::forward<K>(key)),
+                                             std::forward_as_tuple(std::forward<Args>(args)...));
+        return {iterator_at(index), inserted};
+    }
+
+    template <typename K, typename M>
+    std::pair<Iterator, bool> insert_or_assign_key(K&& key, M&& object) {
+        auto [index, inserted] = emplace_key(key, std::forward<K>(key), std::forward<M>(object));
+        if (!inserted) {
+            slots_[index].value.second = std::forward<M>(object);
+        }
+        return {iterator_at(index), inserted};
+    }
+
+    template <typename K>
+    Value& at_key(const K& key) {
+        size_t index = find_index(key, hash_of(key));
+        if (index == capacity_) {
+            throw std::out_of_range("Out of range");
+        }
+        return slots_[index].value.second;
+    }
+
+public:
+    Iterator begin() noexcept {
+        Iterator result = iterator_at(0);
+        result.skip_empty_or_deleted();
+        return result;
+    }
+
+    Iterator end() noexcept {
+        return iterator_at(capacity_);
+    }
+
+    ConstIterator begin() const noexcept {
+        return const_cast<SwissTable*>(this)->begin();
+    }
+
+    ConstIterator end() const noexcept {
+        return iterator_at(capacity_);
+    }
+
+    ConstIterator cbegin() const noexcept {
+        return begin();
+    }
+
+    ConstIterator cend() const noexcept {
+        return end();
+    }
+
+    explicit SwissTable(size_t bucket_count,
+                        const Hash& hash = Hash(),
+                        const Equal& equal = Equal(),
+                        const Alloc& alloc = Alloc())
+        : hash_(hash)
+        , equal_(equal)
+        , alloc_(alloc)
+    {
+        reset();
+        if (bucket_count > 0) {
+            resize(capacity_for(bucket_count));
+        }
+    }
+
+    SwissTable() : SwissTable(0) {}
+
+    SwissTable(size_t bucket_count, const Alloc& alloc)
+        : SwissTable(bucket_count, Hash(), Equal(), alloc)
+    {}
+
+    SwissTable(size_t bucket_count, const Hash& hash, const Alloc& alloc)
+        : SwissTable(bucket_count, hash, Equal(), alloc)
+    {}
+
+    explicit SwissTable(const Alloc& alloc) : SwissTable(0, Hash(), Equal(), alloc) {}
+
+    SwissTable(const SwissTable& other)
+        : SwissTable(0, other.hash_, other.equal_,
+                     traits_t::select_on_container_copy_construction(other.alloc_))
+    {
+        try {
+            copy_from(other);
+        } catch (...) {
+            destroy_elements();
+            deallocate_table();
+            throw;
+        }
+    }
+
+    SwissTable(SwissTable&& other) noexcept
+        : hash_(std::move(other.hash_))
+        , equal_(std::move(other.equal_))
+        , alloc_(std::move(other.alloc_))
+    {
+        take_table(other);
+    }
+
+    ~SwissTable() {
+        destroy_elements();
+        deallocate_table();
+    }
+
+    SwissTable& operator=(const SwissTable& other) {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        deallocate_table();
+        reset();
+        if constexpr (traits_t::propagate_on_container_copy_assignment::value) {
+            alloc_ = other.alloc_;
+        }
+        hash_ = other.hash_;
+        equal_ = other.equal_;
+        copy_from(other);
+        return *this;
+    }
+
+    SwissTable& operator=(SwissTable&& other) noexcept(
+            traits_t::propagate_on_container_move_assignment::value
+            || traits_t::is_always_equal::value) {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        hash_ = std::move(other.hash_);
+        equal_ = std::move(other.equal_);
+        if (traits_t::propagate_on_container_move_assignment::value
+            || traits_t::is_always_equal::value || alloc_ == other.alloc_) {
+            deallocate_table();
+            if constexpr (traits_t::propagate_on_container_move_assignment::value) {
+                alloc_ = other.alloc_;
+            }
+            take_table(other);
+        } else {
+            reserve(other.size_);
+            for (auto& item: other) {
+                emplace(std::move(const_cast<Key&>(item.first)), std::move(item.second));
+            }
+            other.clear();
+        }
+        return *this;
+    }
+
+    // Destroys the elements but keeps the table.
+    void clear() {
+        destroy_elements();
+        if (capacity_ != 0) {
+            std::fill(ctrl_, ctrl_ + ctrl_bytes(capacity_), EMPTY);
+            ctrl_[capacity_] = SENTINEL;
+        }
+        size_ = 0;
+        growth_left_ = capacity_ == 0 ? 0 : max_growth(capacity_);
+    }
+
+    Iterator find(const Key& key) {
+        return iterator_at(find_index(key, hash_of(key)));
+    }
+
+    ConstIterator find(const Key& key) const {
+        return iterator_at(find_index(key, hash_of(key)));
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    Iterator find(const K& key) {
+        return iterator_at(find_index(key, hash_of(key)));
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    ConstIterator find(const K& key) const {
+        return iterator_at(find_index(key, hash_of(key)));
+    }
+
+    bool contains(const Key& key) const {
+        return find_index(key, hash_of(key)) != capacity_;
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    bool contains(const K& key) const {
+        return find_index(key, hash_of(key)) != capacity_;
+    }
+
+private:
+    static constexpr size_t BATCH_SIZE = 16;
+
+    // Like the chained engine's: hash every key of the batch and prefetch its
+    // first group of control bytes, then match the groups and prefetch the
+    // first candidate slot of each, then probe.
+    template <typename KeyIter, typename OutIter, typename Convert>
+    OutIter lookup_batch(KeyIter first, KeyIter last, OutIter out, Convert convert) const {
+        const Key* keys[BATCH_SIZE];
+        size_t hashes[BATCH_SIZE];
+        while (first != last) {
+            size_t count = 0;
+            for (; count < BATCH_SIZE && first != last; ++count, ++first) {
+                keys[count] = &*first;
+                hashes[count] = hash_of(*keys[count]);
+                prefetch(ctrl_ + (h1(hashes[count]) & capacity_));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                size_t offset = h1(hashes[i]) & capacity_;
+                uint64_t mask = Group(ctrl_ + offset).match(h2(hashes[i]));
+                if (mask != 0) {
+                    prefetch(slots_ + ((offset + lowest(mask)) & capacity_));
+                }
+            }
+            for (size_t i = 0; i < count; ++i) {
+                *out++ = convert(find_index(*keys[i], hashes[i]));
+            }
+        }
+        return out;
+    }
+
+public:
+    template <typename KeyIter, typename OutIter>
+    OutIter find_batch(KeyIter first, KeyIter last, OutIter out) {
+        return lookup_batch(first, last, out, [this](size_t index) { return iterator_at(index); });
+    }
+
+    template <typename KeyIter, typename OutIter>
+    OutIter contains_batch(KeyIter first, KeyIter last, OutIter out) const {
+        return lookup_batch(first, last, out, [this](size_t index) { return index != capacity_; });
+    }
+
+    Iterator erase(ConstIterator iter) {
+        size_t index = iter.ctrl_ - ctrl_;
+        traits_t::destroy(alloc_, &slots_[index].value);
+        set_ctrl(index, DELETED);
+        --size_;
+        Iterator next = iterator_at(index);
+        ++next;
+        return next;
+    }
+
+    Iterator erase(ConstIterator first, ConstIterator last) {
+        while (first != last) {
+            first = erase(first);
+        }
+        return iterator_at(last.ctrl_ - ctrl_);
+    }
+
+    // Makes room for count elements without further rehashing.
+    void rehash(size_t count) {
+        size_t capacity = capacity_for(std::max(count, size_));
+        if (capacity > capacity_ || count == 0) {
+            resize(capacity);
+        }
+    }
+
+    void reserve(size_t count) {
+        if (count > size_ + growth_left_) {
+            resize(capacity_for(count));
+        }
+    }
+
+    // Builds the element first, since its key is needed to find its place,
+    // and moves it into its slot only if the key is new.
+    template <typename... Args>
+    std::pair<Iterator, bool> emplace(Args&&... args) {
+        alignas(Slot) unsigned char buffer[sizeof(Slot)];
+        Slot* staged = reinterpret_cast<Slot*>(buffer);
+        traits_t::construct(alloc_, &staged->value, std::forward<Args>(args)...);
+        try {
+            size_t hash = hash_of(staged->value.first);
+            size_t index = find_index(staged->value.first, hash);
+            if (index != capacity_) {
+                traits_t::destroy(alloc_, &staged->value);
+                return {iterator_at(index), false};
+            }
+            index = prepare_insert(hash);
+            try {
+                relocate(slots_ + index, staged);
+            } catch (...) {
+                abandon_insert(index);
+                throw;
+            }
+            return {iterator_at(index), true};
+        } catch (...) {
+            traits_t::destroy(alloc_, &staged->value);
+            throw;
+        }
+    }
+
+    template <typename... Args>
+    std::pair<Iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        return try_emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<Iterator, bool> try_emplace(Key&& key, Args&&... args) {
+        return try_emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename M>
+    std::pair<Iterator, bool> insert_or_assign(const Key& key, M&& object) {
+        return insert_or_assign_key(key, std::forward<M>(object));
+    }
+
+    template <typename M>
+    std::pair<Iterator, bool> insert_or_assign(Key&& key, M&& object) {
+        return insert_or_assign_key(std::move(key), std::forward<M>(object));
+    }
+
+    Value& operator[](const Key& key) {
+        return try_emplace_key(key).first->second;
+    }
+
+    Value& operator[](Key&& key) {
+        return try_emplace_key(std::move(key)).first->second;
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    Value& operator[](K&& key) {
+        return try_emplace_key(std::forward<K>(key)).first->second;
+    }
+
+    Value& at(const Key& key) {
+        return at_key(key);
+    }
+
+    const Value& at(const Key& key) const {
+        return const_cast<SwissTable*>(this)->at_key(key);
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    Value& at(const K& key) {
+        return at_key(key);
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    const Value& at(const K& key) const {
+        return const_cast<SwissTable*>(this)->at_key(key);
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    std::pair<Iterator, bool> insert(const NodeType& node) {
+        auto [index, inserted] = emplace_key(node.first, node);
+        return {iterator_at(index), inserted};
+    }
+
+    std::pair<Iterator, bool> insert(NodeType&& node) {
+        return emplace(std::move(const_cast<Key&>(node.first)), std::move(node.second));
+    }
+
+    template <typename InputIter>
+    void insert(InputIter first, InputIter last) {
+        while (first != last) {
+            insert(*first++);
+        }
+    }
+
+    size_t max_size() const {
+        return slot_traits_t::max_size(SlotAlloc(alloc_));
+    }
+
+    size_t bucket_count() const {
+        return capacity_;
+    }
+
+    double load_factor() const {
+        return capacity_ == 0 ? 0.0 : static_cast<double>(size_) / static_cast<double>(capacity_);
+    }
+
+    double max_load_factor() const {
+        return 0.875;
+    }
+};
+
+// The Swiss table has a bucket scheme of its own and ignores RehashPolicy.
+template <typename Key, typename Value, typename Hash, typename Equal, typename Alloc,
+          typename RehashPolicy>
+class UnorderedMap<Key, Value, Hash, Equal, Alloc, SwissLayout, RehashPolicy>
+    : public SwissTable<Key, Value, Hash, Equal, Alloc> {
+public:
+    using SwissTable<Key, Value, Hash, Equal, Alloc>::SwissTable;
+
+    UnorderedMap() = default;
+};
+
+// Open-addressing engine for UnorderedMap<..., RobinHoodLayout>: linear probing
+// in which a new element takes the slot of any resident that is closer to its
+// own home slot, pushing the rest of the run one slot on (Celis' Robin Hood
+// hashing). Runs thus stay sorted by home slot, and each slot records how far
+// its element is from home. A lookup stops at the first slot whose element is
+// closer to home than the key would be there, since the key would have taken
+// that slot: a miss reads about as many slots as a hit, however full the table.
+//
+// Erasure shifts the rest of the run back by one slot instead of leaving a
+// tombstone, so long-lived tables don't degrade. Like SwissTable, the elements
+// live inline, and a rehash invalidates iterators and references; so does any
+// insertion or erasure, since both may move other elements of the run.
+template <
+    typename Key,
+    typename Value,
+    typename Hash = std::hash<Key>,
+    typename Equal = std::equal_to<Key>,
+    typename Alloc = std::allocator<std::pair<const Key, Value> >
+>
+class RobinHoodTable {
+public:
+    using NodeType = std::pair<const Key, Value>;
+
+    // Probe lengths of the elements, that is how many slots a successful
+    // lookup of each reads.
+    struct ProbeStats {
+        double mean = 0;
+        double variance = 0;
+        size_t longest = 0;
+    };
+
+private:
+    // Distance from the home slot plus one, so that zero can mean empty.
+    using dist_t = uint16_t;
+
+    template <typename K>
+    using EnableIfTransparent = std::enable_if_t<is_transparent_lookup<Hash, Equal>::value, K>;
+
+    static constexpr dist_t EMPTY = 0;
+    static constexpr dist_t SENTINEL = 0xFFFF;
+
+    // An insertion that would leave an element further from home than this
+    // grows the table instead. Rehashing ignores the limit, which is far below
+    // what dist_t holds.
+    static constexpr size_t PROBE_LIMIT = 4096;
+    static constexpr size_t MIN_CAPACITY = 8;
+
+    using MutableNode = std::pair<Key, Value>;
+
+    // Inserts, erasures and rehashes shift elements along their runs by move
+    // construction; a move that threw halfway would leave a run torn apart.
+    static_assert(std::is_nothrow_move_constructible_v<MutableNode>,
+                  "RobinHoodLayout needs keys and values that are nothrow move constructible");
+
+    union Slot {
+        NodeType value;
+        MutableNode mutable_value;
+
+        Slot() {}
+
+        ~Slot() {}
+    };
+
+    using traits_t = std::allocator_traits<Alloc>;
+    using MutableAlloc = typename traits_t::template rebind_alloc<MutableNode>;
+    using mutable_traits_t = std::allocator_traits<MutableAlloc>;
+    using SlotAlloc = typename traits_t::template rebind_alloc<Slot>;
+    using slot_traits_t = std::allocator_traits<SlotAlloc>;
+    using DistAlloc = typename traits_t::template rebind_alloc<dist_t>;
+    using dist_traits_t = std::allocator_traits<DistAlloc>;
+
+    dist_t* dist_;
+    Slot* slots_;
+    size_t capacity_;
+    size_t mask_;
+    size_t size_;
+    size_t growth_left_;
+
+    Hash hash_;
+    Equal equal_;
+    Alloc alloc_;
+
+    // Distances of a table with no slots: one empty slot, where every lookup
+    // stops, then the sentinel that stops iteration.
+    static dist_t* empty_table() {
+        static dist_t table[2] = {EMPTY, SENTINEL};
+        return table;
+    }
+
+    static size_t max_growth(size_t capacity) {
+        return capacity - capacity / 5;
+    }
+
+    // Smallest power of two that holds count elements.
+    static size_t capacity_for(size_t count) {
+        size_t capacity = MIN_CAPACITY;
+        while (max_growth(capacity) < count) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    template <typename K>
+    size_t hash_of(const K& key) const {
+        return mix_hash(hash_(key));
+    }
+
+    size_t end_index() const {
+        return mask_ + 1;
+    }
+
+    template <typename K>
+    size_t find_index(const K& key, size_t hash) const {
+        size_t index = hash & mask_;
+        for (size_t probe = 1; dist_[index] >= probe; ++probe) {
+            if (dist_[index] == probe && equal_(slots_[index].value.first, key)) {
+                return index;
+            }
+            index = (index + 1) & mask_;
+        }
+        return end_index();
+    }
+
+    void relocate(Slot* to, Slot* from) {
+        MutableAlloc mutable_alloc(alloc_);
+        mutable_traits_t::construct(mutable_alloc, &to->mutable_value, std::move(from->mutable_value));
+        traits_t::destroy(alloc_, &from->value);
+    }
+
+    // Makes room for an element with the given hash, shifting the elements
+    // from its place up to the next empty slot one slot on, and returns its
+    // index; or returns end_index() if someone would end up more than limit
+    // slots from home. The slot's distance is set, its element is not.
+    size_t place(size_t hash, size_t limit) {
+        size_t index = hash & mask_;
+        size_t probe = 1;
+        while (dist_[index] >= probe) {
+            index = (index + 1) & mask_;
+            ++probe;
+        }
+        size_t empty = index;
+        while (dist_[empty] != EMPTY && dist_[empty] < limit) {
+            empty = (empty + 1) & mask_;
+        }
+        if (probe > limit || dist_[empty] != EMPTY) {
+            return end_index();
+        }
+        for (size_t to = empty; to != index; ) {
+            size_t from = (to - 1) & mask_;
+            relocate(slots_ + to, slots_ + from);
+            dist_[to] = static_cast<dist_t>(dist_[from] + 1);
+            to = from;
+        }
+        dist_[index] = static_cast<dist_t>(probe);
+        return index;
+    }
+
+    // Empties the slot at index, whose element is already destroyed, and
+    // shifts the rest of its run back by one. Returns how many elements moved.
+    size_t erase_slot(size_t index) {
+        size_t moved = 0;
+        size_t next = (index + 1) & mask_;
+        while (dist_[next] > 1) {
+            relocate(slots_ + index, slots_ + next);
+            dist_[index] = static_cast<dist_t>(dist_[next] - 1);
+            index = next;
+            next = (next + 1) & mask_;
+            ++moved;
+        }
+        dist_[index] = EMPTY;
+        --size_;
+        ++growth_left_;
+        return moved;
+    }
+
+    void deallocate_table() {
+        if (capacity_ == 0) {
+            return;
+        }
+        DistAlloc dist_alloc(alloc_);
+        SlotAlloc slot_alloc(alloc_);
+        dist_traits_t::deallocate(dist_alloc, dist_, capacity_ + 1);
+        slot_traits_t::deallocate(slot_alloc, slots_, capacity_);
+    }
+
+    void destroy_elements() {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (dist_[i] != EMPTY) {
+                traits_t::destroy(alloc_, &slots_[i].value);
+            }
+        }
+    }
+
+    void reset() {
+        dist_ = empty_table();
+        slots_ = nullptr;
+        capacity_ = 0;
+        mask_ = 0;
+        size_ = 0;
+        growth_left_ = 0;
+    }
+
+    // Moves every element into a fresh table of new_capacity slots. The
+    // hashes are computed before anything moves, so a throwing hash leaves the
+    // table as it was, and nothing after that can throw: moves are nothrow, and
+    // placing only fails once an element lands SENTINEL - 1 slots from home,
+    // which takes a cluster of tens of thousands of keys; inserts give up on
+    // far shorter runs (PROBE_LIMIT).
+    void resize(size_t new_capacity) {
+        constexpr bool PRECOMPUTE_HASHES = !std::is_nothrow_invocable_v<const Hash&, const Key&>;
+        std::vector<size_t> hashes;
+        if constexpr (PRECOMPUTE_HASHES) {
+            hashes.reserve(size_);
+            for (size_t i = 0; i < capacity_; ++i) {
+                if (dist_[i] != EMPTY) {
+                    hashes.push_back(hash_of(slots_[i].value.first));
+                }
+            }
+        }
+
+        DistAlloc dist_alloc(alloc_);
+        SlotAlloc slot_alloc(alloc_);
+        dist_t* new_dist = dist_traits_t::allocate(dist_alloc, new_capacity + 1);
+        Slot* new_slots;
+        try {
+            new_slots = slot_traits_t::allocate(slot_alloc, new_capacity);
+        } catch (...) {
+            dist_traits_t::deallocate(dist_alloc, new_dist, new_capacity + 1);
+            throw;
+        }
+        std::fill(new_dist, new_dist + new_capacity, EMPTY);
+        new_dist[new_capacity] = SENTINEL;
+
+        dist_t* old_dist = dist_;
+        Slot* old_slots = slots_;
+        size_t old_capacity = capacity_;
+        dist_ = new_dist;
+        slots_ = new_slots;
+        capacity_ = new_capacity;
+        mask_ = new_capacity - 1;
+        size_t next_hash = 0;
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old_dist[i] != EMPTY) {
+                size_t hash;
+                if constexpr (PRECOMPUTE_HASHES) {
+                    hash = hashes[next_hash++];
+                } else {
+                    hash = hash_of(old_slots[i].value.first);
+                }
+                size_t index = place(hash, SENTINEL - 1);
+                assert(index != end_index());
+                relocate(slots_ + index, old_slots + i);
+            }
+        }
+        growth_left_ = max_growth(capacity_) - size_;
+        if (old_capacity != 0) {
+            dist_traits_t::deallocate(dist_alloc, old_dist, old_capacity + 1);
+            slot_traits_t::deallocate(slot_alloc, old_slots, old_capacity);
+        }
+    }
+
+    // Finds a slot for a new element with the given hash, growing the table if
+    // it is full or if the element's run has grown too long. A long run in a
+    // sparse table means that the hash function sends many keys to one slot,
+    // which growing would not fix.
+    size_t prepare_insert(size_t hash) {
+        if (growth_left_ == 0) {
+            resize(capacity_ == 0 ? MIN_CAPACITY : capacity_ * 2);
+        }
+        while (true) {
+            size_t index = place(hash, PROBE_LIMIT);
+            if (index != end_index()) {
+                ++size_;
+                --growth_left_;
+                return index;
+            }
+            if (size_ < max_growth(capacity_) / 8) {
+                throw std::length_error("RobinHoodTable: too many keys with the same hash");
+            }
+            resize(capacity_ * 2);
+        }
+    }
+
+    // Undoes prepare_insert when constructing the element threw.
+    void abandon_insert(size_t index) {
+        erase_slot(index);
+    }
+
+    // Constructs the element from args only if key is missing.
+    template <typename K, typename... Args>
+    std::pair<size_t, bool> emplace_key(const K& key, Args&&... args) {
+        size_t hash = hash_of(key);
+        size_t index = find_index(key, hash);
+        if (index != end_index()) {
+            return {index, false};
+        }
+        index = prepare_insert(hash);
+        try {
+            traits_t::construct(alloc_, &slots_[index].value, std::forward<Args>(args)...);
+        } catch (...) {
+            abandon_insert(index);
+            throw;
+        }
+        return {index, true};
+    }
+
+    void copy_from(const RobinHoodTable& other) {
+        if (other.size_ == 0) {
+            return;
+        }
+        resize(capacity_for(other.size_));
+        for (size_t i = 0; i < other.capacity_; ++i) {
+            if (other.dist_[i] != EMPTY) {
+                size_t index = prepare_insert(hash_of(other.slots_[i].value.first));
+                try {
+                    traits_t::construct(alloc_, &slots_[index].value, other.slots_[i].value);
+                } catch (...) {
+                    abandon_insert(index);
+                    throw;
+                }
+            }
+        }
+    }
+
+    void take_table(RobinHoodTable& other) noexcept {
+        dist_ = other.dist_;
+        slots_ = other.slots_;
+        capacity_ = other.capacity_;
+        mask_ = other.mask_;
+        size_ = other.size_;
+        growth_left_ = other.growth_left_;
+        other.reset();
+    }
+
+public:
+    template <bool IsConst>
+    class CommonIterator {
+    private:
+        dist_t* dist_;
+        Slot* slot_;
+        // Start of the tail of the table that holds elements this iteration
+        // has already passed, shifted there from the front by erase.
+        dist_t* covered_ = nullptr;
+
+        void skip_empty() {
+            while (*dist_ == EMPTY) {
+                ++dist_;
+                ++slot_;
+            }
+            if (covered_ != nullptr && dist_ >= covered_) {
+                while (*dist_ != SENTINEL) {
+                    ++dist_;
+                    ++slot_;
+                }
+            }
+        }
+
+    public:
+        using value_type = std::conditional_t<IsConst, const NodeType, NodeType>;
+        using pointer = std::conditional_t<IsConst, const NodeType*, NodeType*>;
+        using reference = std::conditional_t<IsConst, const NodeType&, NodeType&>;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        CommonIterator(dist_t* dist, Slot* slot) : dist_(dist), slot_(slot) {}
+
+        CommonIterator(const CommonIterator<false>& other)
+            : dist_(other.dist_), slot_(other.slot_), covered_(other.covered_) {}
+
+        CommonIterator& operator=(const CommonIterator<false>& other) {
+            dist_ = other.dist_;
+            slot_ = other.slot_;
+            covered_ = other.covered_;
+            return *this;
+        }
+
+        ~CommonIterator() = default;
+
+        CommonIterator& operator++() {
+            ++dist_;
+            ++slot_;
+            skip_empty();
+            return *this;
+        }
+
+        CommonIterator operator++(int) {
+            CommonIterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        reference operator*() const {
+            return slot_->value;
+        }
+
+        pointer operator->() const {
+            return &slot_->value;
+        }
+
+        template <bool IsConstOther>
+        bool operator==(CommonIterator<IsConstOther> other) const {
+            return dist_ == other.dist_;
+        }
+
+        template <bool IsConstOther>
+        bool operator!=(CommonIterator<IsConstOther> other) const {
+            return !(*this == other);
+        }
+
+        template <bool IsConstOther>
+        friend class CommonIterator;
+
+        friend class RobinHoodTable;
+    };
+
+    using Iterator = CommonIterator<false>;
+    using ConstIterator = CommonIterator<true>;
+
+private:
+    Iterator iterator_at(size_t index) const {
+        return Iterator(dist_ + index, slots_ + index);
+    }
+
+    template <typename K, typename... Args>
+    std::pair<Iterator, bool> try_emplace_key(K&& key, Args&&... args) {
+        auto [index, inserted] = emplace_key(key, std::piecewise_construct,
+                                             std::forward_as_tuple(std::forward<K>(key)),
+                                             std::forward_as_tuple(std::forward<Args>(args)...));
+        return {iterator_at(index), inserted};
+    }
+
+    template <typename K, typename M>
+    std::pair<Iterator, bool> insert_or_assign_key(K&& key, M&& object) {
+        auto [index, inserted] = emplace_key(key, std::forward<K>(key), std::forward<M>(object));
+        if (!inserted) {
+            slots_[index].value.second = std::forward<M>(object);
+        }
+        return {iterator_at(index), inserted};
+    }
+
+    template <typename K>
+    Value& at_key(const K& key) {
+        size_t index = find_index(key, hash_of(key));
+        if (index == end_index()) {
+            throw std::out_of_range("Out of range");
+        }
+        return slots_[index].value.second;
+    }
+
+public:
+    Iterator begin() noexcept {
+        Iterator result = iterator_at(0);
+        result.skip_empty();
+        return result;
+    }
+
+    Iterator end() noexcept {
+        return iterator_at(end_index());
+    }
+
+    ConstIterator begin() const noexcept {
+        return const_cast<RobinHoodTable*>(this)->begin();
+    }
+
+    ConstIterator end() const noexcept {
+        return iterator_at(end_index());
+    }
+
+    ConstIterator cbegin() const noexcept {
+        return begin();
+    }
+
+    ConstIterator cend() const noexcept {
+        return end();
+    }
+
+    explicit RobinHoodTable(size_t bucket_count,
+                            const Hash& hash = Hash(),
+                            const Equal& equal = Equal(),
+                            const Alloc& alloc = Alloc())
+        : hash_(hash)
+        , equal_(equal)
+        , alloc_(alloc)
+    {
+        reset();
+        if (bucket_count > 0) {
+            resize(capacity_for(bucket_count));
+        }
+    }
+
+    RobinHoodTable() : RobinHoodTable(0) {}
+
+    RobinHoodTable(size_t bucket_count, const Alloc& alloc)
+        : RobinHoodTable(bucket_count, Hash(), Equal(), alloc)
+    {}
+
+    RobinHoodTable(size_t bucket_count, const Hash& hash, const Alloc& alloc)
+        : RobinHoodTable(bucket_count, hash, Equal(), alloc)
+    {}
+
+    explicit RobinHoodTable(const Alloc& alloc) : RobinHoodTable(0, Hash(), Equal(), alloc) {}
+
+    RobinHoodTable(const RobinHoodTable& other)
+        : RobinHoodTable(0, other.hash_, other.equal_,
+                         traits_t::select_on_container_copy_construction(other.alloc_))
+    {
+        try {
+            copy_from(other);
+        } catch (...) {
+            destroy_elements();
+            deallocate_table();
+            throw;
+        }
+    }
+
+    RobinHoodTable(RobinHoodTable&& other) noexcept
+        : hash_(std::move(other.hash_))
+        , equal_(std::move(other.equal_))
+        , alloc_(std::move(other.alloc_))
+    {
+        take_table(other);
+    }
+
+    ~RobinHoodTable() {
+        destroy_elements();
+        deallocate_table();
+    }
+
+    RobinHoodTable& operator=(const RobinHoodTable& other) {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        deallocate_table();
+        reset();
+        if constexpr (traits_t::propagate_on_container_copy_assignment::value) {
+            alloc_ = other.alloc_;
+        }
+        hash_ = other.hash_;
+        equal_ = other.equal_;
+        copy_from(other);
+        return *this;
+    }
+
+    RobinHoodTable& operator=(RobinHoodTable&& other) noexcept(
+            traits_t::propagate_on_container_move_assignment::value
+            || traits_t::is_always_equal::value) {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        hash_ = std::move(other.hash_);
+        equal_ = std::move(other.equal_);
+        if (traits_t::propagate_on_container_move_assignment::value
+            || traits_t::is_always_equal::value || alloc_ == other.alloc_) {
+            deallocate_table();
+            if constexpr (traits_t::propagate_on_container_move_assignment::value) {
+                alloc_ = other.alloc_;
+            }
+            take_table(other);
+        } else {
+            reserve(other.size_);
+            for (auto& item: other) {
+                emplace(std::move(const_cast<Key&>(item.first)), std::move(item.second));
+            }
+            other.clear();
+        }
+        return *this;
+    }
+
+    // Destroys the elements but keeps the table.
+    void clear() {
+        destroy_elements();
+        if (capacity_ != 0) {
+            std::fill(dist_, dist_ + capacity_, EMPTY);
+        }
+        size_ = 0;
+        growth_left_ = capacity_ == 0 ? 0 : max_growth(capacity_);
+    }
+
+    Iterator find(const Key& key) {
+        return iterator_at(find_index(key, hash_of(key)));
+    }
+
+    ConstIterator find(const Key& key) const {
+        return iterator_at(find_index(key, hash_of(key)));
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    Iterator find(const K& key) {
+        return iterator_at(find_index(key, hash_of(key)));
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    ConstIterator find(const K& key) const {
+        return iterator_at(find_index(key, hash_of(key)));
+    }
+
+    bool contains(const Key& key) const {
+        return find_index(key, hash_of(key)) != end_index();
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    bool contains(const K& key) const {
+        return find_index(key, hash_of(key)) != end_index();
+    }
+
+private:
+    static constexpr size_t BATCH_SIZE = 16;
+
+    // Hashes every key of the batch and prefetches its home slot and distance,
+    // then probes.
+    template <typename KeyIter, typename OutIter, typename Convert>
+    OutIter lookup_batch(KeyIter first, KeyIter last, OutIter out, Convert convert) const {
+        const Key* keys[BATCH_SIZE];
+        size_t hashes[BATCH_SIZE];
+        while (first != last) {
+            size_t count = 0;
+            for (; count < BATCH_SIZE && first != last; ++count, ++first) {
+                keys[count] = &*first;
+                hashes[count] = hash_of(*keys[count]);
+                prefetch(dist_ + (hashes[count] & mask_));
+                prefetch(slots_ + (hashes[count] & mask_));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                *out++ = convert(find_index(*keys[i], hashes[i]));
+            }
+        }
+        return out;
+    }
+
+public:
+    template <typename KeyIter, typename OutIter>
+    OutIter find_batch(KeyIter first, KeyIter last, OutIter out) {
+        return lookup_batch(first, last, out, [this](size_t index) { return iterator_at(index); });
+    }
+
+    template <typename KeyIter, typename OutIter>
+    OutIter contains_batch(KeyIter first, KeyIter last, OutIter out) const {
+        return lookup_batch(first, last, out, [this](size_t index) {
+            return index != end_index();
+        });
+    }
+
+    // The rest of the run moves back into the erased slot, so the iterator
+    // returned may point at the same slot. A run that wraps around pulls the
+    // element in slot 0, which iteration has already passed, into the last
+    // slot; the iterator then remembers that the tail from there on is
+    // covered and ends before it. The covered tail moves back with the run on
+    // later erasures.
+    Iterator erase(ConstIterator iter) {
+        size_t index = iter.dist_ - dist_;
+        size_t covered = iter.covered_ == nullptr ? end_index() : iter.covered_ - dist_;
+        traits_t::destroy(alloc_, &slots_[index].value);
+        size_t moved = erase_slot(index);
+        if (covered != end_index() && index + moved >= covered) {
+            --covered;
+        }
+        if (index + moved > mask_) {
+            covered = std::min(covered, mask_);
+        }
+        Iterator next = iterator_at(index);
+        if (covered != end_index()) {
+            next.covered_ = dist_ + covered;
+        }
+        next.skip_empty();
+        return next;
+    }
+
+    // Erasing shifts elements, so last may not point at the same element
+    // afterwards: the range is counted first.
+    Iterator erase(ConstIterator first, ConstIterator last) {
+        size_t count = 0;
+        for (ConstIterator iter = first; iter != last; ++iter) {
+            ++count;
+        }
+        Iterator result = iterator_at(first.dist_ - dist_);
+        result.covered_ = first.covered_;
+        for (; count > 0; --count) {
+            result = erase(result);
+        }
+        return result;
+    }
+
+    // Makes room for count elements without further rehashing.
+    void rehash(size_t count) {
+        size_t capacity = capacity_for(std::max(count, size_));
+        if (capacity > capacity_ || count == 0) {
+            resize(capacity);
+        }
+    }
+
+    void reserve(size_t count) {
+        if (count > size_ + growth_left_) {
+            resize(capacity_for(count));
+        }
+    }
+
+    // Builds the element first, since its key is needed to find its place,
+    // and moves it into its slot only if the key is new.
+    template <typename... Args>
+    std::pair<Iterator, bool> emplace(Args&&... args) {
+        alignas(Slot) unsigned char buffer[sizeof(Slot)];
+        Slot* staged = reinterpret_cast<Slot*>(buffer);
+        traits_t::construct(alloc_, &staged->value, std::forward<Args>(args)...);
+        try {
+            size_t hash = hash_of(staged->value.first);
+            size_t index = find_index(staged->value.first, hash);
+            if (index != end_index()) {
+                traits_t::destroy(alloc_, &staged->value);
+                return {iterator_at(index), false};
+            }
+            index = prepare_insert(hash);
+            try {
+                relocate(slots_ + index, staged);
+            } catch (...) {
+                abandon_insert(index);
+                throw;
+            }
+            return {iterator_at(index), true};
+        } catch (...) {
+            traits_t::destroy(alloc_, &staged->value);
+            throw;
+        }
+    }
+
+    template <typename... Args>
+    std::pair<Iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        return try_emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<Iterator, bool> try_emplace(Key&& key, Args&&... args) {
+        return try_emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename M>
+    std::pair<Iterator, bool> insert_or_assign(const Key& key, M&& object) {
+        return insert_or_assign_key(key, std::forward<M>(object));
+    }
+
+    template <typename M>
+    std::pair<Iterator, bool> insert_or_assign(Key&& key, M&& object) {
+        return insert_or_assign_key(std::move(key), std::forward<M>(object));
+    }
+
+    Value& operator[](const Key& key) {
+        return try_emplace_key(key).first->second;
+    }
+
+    Value& operator[](Key&& key) {
+        return try_emplace_key(std::move(key)).first->second;
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    Value& operator[](K&& key) {
+        return try_emplace_key(std::forward<K>(key)).first->second;
+    }
+
+    Value& at(const Key& key) {
+        return at_key(key);
+    }
+
+    const Value& at(const Key& key) const {
+        return const_cast<RobinHoodTable*>(this)->at_key(key);
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    Value& at(const K& key) {
+        return at_key(key);
+    }
+
+    template <typename K, typename = EnableIfTransparent<K> >
+    const Value& at(const K& key) const {
+        return const_cast<RobinHoodTable*>(this)->at_key(key);
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    std::pair<Iterator, bool> insert(const NodeType& node) {
+        auto [index, inserted] = emplace_key(node.first, node);
+        return {iterator_at(index), inserted};
+    }
+
+    std::pair<Iterator, bool> insert(NodeType&& node) {
+        return emplace(std::move(const_cast<Key&>(node.first)), std::move(node.second));
+    }
+
+    template <typename InputIter>
+    void insert(InputIter first, InputIter last) {
+        while (first != last) {
+            insert(*first++);
+        }
+    }
+
+    size_t max_size() const {
+        return slot_traits_t::max_size(SlotAlloc(alloc_));
+    }
+
+    size_t bucket_count() const {
+        return capacity_;
+    }
+
+    double load_factor() const {
+        return capacity_ == 0 ? 0.0 : static_cast<double>(size_) / static_cast<double>(capacity_);
+    }
+
+    double max_load_factor() const {
+        return 0.8;
+    }
+
+    // Walks the whole table; meant for tuning and tests, not for hot paths.
+    ProbeStats probe_stats() const {
+        ProbeStats stats;
+        if (size_ == 0) {
+            return stats;
+        }
+        double sum = 0;
+        double squares = 0;
+        for (size_t i = 0; i < capacity_; ++i) {
+            sum += dist_[i];
+            squares += static_cast<double>(dist_[i]) * dist_[i];
+            stats.longest = std::max<size_t>(stats.longest, dist_[i]);
+        }
+        stats.mean = sum / static_cast<double>(size_);
+        stats.variance = squares / static_cast<double>(size_) - stats.mean * stats.mean;
+        return stats;
+    }
+};
+
+// The Robin Hood table, like the Swiss one, has a bucket scheme of its own.
+template <typename Key, typename Value, typename Hash, typename Equal, typename Alloc,
+          typename RehashPolicy>
+class UnorderedMap<Key, Value, Hash, Equal, Alloc, RobinHoodLayout, RehashPolicy>
+    : public RobinHoodTable<Key, Value, Hash, Equal, Alloc> {
+public:
+    using RobinHoodTable<Key, Value, Hash, Equal, Alloc>::RobinHoodTable;
+
+    UnorderedMap() = default;
+};
+
+// UnorderedMap split into independently locked shards, for maps shared between
+// threads. A key's shard is chosen by the top bits of its mixed hash, so it
+// doesn't correlate with the bucket inside the shard. Lookups take the shard's
+// lock shared, so readers of the same shard only contend on the lock word;
+// writers lock one shard exclusively and leave the others alone.
+//
+// Readers lock rather than read optimistically under a sequence counter: a
+// chained shard is a web of pointers that a concurrent writer may be freeing,
+// and a seqlock reader would follow them before it could tell its read was
+// stale.
+//
+// References into the map would outlive the lock, so lookups return copies or
+// run a callback under the lock, and updates are read-modify-write callbacks
+// that are atomic with respect to all other operations on the key.
+template <
+    typename Key,
+    typename Value,
+    typename Hash = std::hash<Key>,
+    typename Equal = std::equal_to<Key>,
+    typename Alloc = std::allocator<std::pair<const Key, Value> >,
+    typename Layout = ChainedLayout,
+    typename RehashPolicy = ModuloRehashPolicy
+>
+class ConcurrentUnorderedMap {
+public:
+    using MapType = UnorderedMap<Key, Value, Hash, Equal, Alloc, Layout, RehashPolicy>;
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    struct alignas(CACHE_LINE) Shard {
+        mutable std::shared_mutex mutex;
+        MapType map;
+
+        explicit Shard(const Alloc& alloc) : map(alloc) {}
+    };
+
+    std::vector<std::unique_ptr<Shard> > shards_;
+    size_t shift_;
+    Hash hash_;
+
+    // Rounds up to a power of two, so that the shard is a shift of the hash.
+    static size_t shard_count_for(size_t requested) {
+        size_t count = 1;
+        while (count < requested) {
+            count *= 2;
+        }
+        return count;
+    }
+
+    template <typename MakeAlloc>
+    void create_shards(size_t shard_count, MakeAlloc make_alloc) {
+        shard_count = shard_count_for(shard_count);
+        shift_ = 64;
+        for (size_t count = shard_count; count > 1; count /= 2) {
+            --shift_;
+        }
+        shards_.reserve(shard_count);
+        for (size_t i = 0; i < shard_count; ++i) {
+            shards_.push_back(std::make_unique<Shard>(make_alloc(i)));
+        }
+    }
+
+    Shard& shard_for(const Key& key) const {
+        uint64_t hash = mix_hash(hash_(key));
+        return *shards_[shift_ == 64 ? 0 : static_cast<size_t>(hash >> shift_)];
+    }
+
+public:
+    // A few shards per hardware thread keep the chance that two threads want
+    // the same shard at the same time low.
+    static size_t default_shard_count() {
+        return 4 * std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+
+    explicit ConcurrentUnorderedMap(size_t shard_count = default_shard_count(),
+                                    const Alloc& alloc = Alloc()) {
+        create_shards(shard_count, [&alloc](size_t) { return alloc; });
+    }
+
+    // make_alloc(i) gives the allocator of shard i, so that each shard can
+    // draw from an arena of its own.
+    template <typename MakeAlloc,
+              typename = std::enable_if_t<std::is_invocable_r_v<Alloc, MakeAlloc, size_t> > >
+    ConcurrentUnorderedMap(size_t shard_count, MakeAlloc make_alloc) {
+        create_shards(shard_count, make_alloc);
+    }
+
+    ConcurrentUnorderedMap(const ConcurrentUnorderedMap&) = delete;
+
+    ConcurrentUnorderedMap& operator=(const ConcurrentUnorderedMap&) = delete;
+
+    size_t shard_count() const {
+        return shards_.size();
+    }
+
+    // Returns false if the key was already there, leaving it unchanged.
+    template <typename... Args>
+    bool try_emplace(const Key& key, Args&&... args) {
+        Shard& shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.try_emplace(key, std::forward<Args>(args)...).second;
+    }
+
+    bool insert(const Key& key, const Value& value) {
+        return try_emplace(key, value);
+    }
+
+    // Inserts value if key is missing, and calls update(existing value)
+    // otherwise. Returns true if it inserted.
+    template <typename Update>
+    bool insert_or_update(const Key& key, const Value& value, Update update) {
+        Shard& shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto [iter, inserted] = shard.map.try_emplace(key, value);
+        if (!inserted) {
+            update(iter->second);
+        }
+        return inserted;
+    }
+
+    // Calls compute with the current value of key, or with an empty optional if
+    // there is none. Whatever compute leaves in the optional becomes the new
+    // value; leaving it empty erases the key. If compute throws, the value is
+    // moved back from the optional, so a callback that throws before touching
+    // it leaves the map as it was; one that emptied the optional first leaves
+    // the key erased rather than holding a moved-from value.
+    template <typename Compute>
+    void compute(const Key& key, Compute compute) {
+        Shard& shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto iter = shard.map.find(key);
+        std::optional<Value> value;
+        if (iter != shard.map.end()) {
+            value.emplace(std::move(iter->second));
+        }
+        try {
+            compute(value);
+        } catch (...) {
+            if (iter != shard.map.end()) {
+                if (value) {
+                    iter->second = std::move(*value);
+                } else {
+                    shard.map.erase(iter);
+                }
+            }
+            throw;
+        }
+        if (value) {
+            if (iter != shard.map.end()) {
+                iter->second = std::move(*value);
+            } else {
+                shard.map.try_emplace(key, std::move(*value));
+            }
+        } else if (iter != shard.map.end()) {
+            shard.map.erase(iter);
+        }
+    }
+
+    bool erase(const Key& key) {
+        Shard& shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto iter = shard.map.find(key);
+        if (iter == shard.map.end()) {
+            return false;
+        }
+        shard.map.erase(iter);
+        return true;
+    }
+
+    std::optional<Value> find(const Key& key) const {
+        Shard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto iter = shard.map.find(key);
+        if (iter == shard.map.end()) {
+            return std::nullopt;
+        }
+        return iter->second;
+    }
+
+    bool contains(const Key& key) const {
+        Shard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.find(key) != shard.map.end();
+    }
+
+    // Calls visitor(value) under the shard's shared lock, without copying the
+    // value out. Returns false if the key is missing.
+    template <typename Visitor>
+    bool visit(const Key& key, Visitor visitor) const {
+        Shard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto iter = shard.map.find(key);
+        if (iter == shard.map.end()) {
+            return false;
+        }
+        visitor(static_cast<const Value&>(iter->second));
+        return true;
+    }
+
+    // Calls visitor(key, value) for every element, one shard at a time. It is
+    // not a snapshot: shards already visited may change meanwhile.
+    template <typename Visitor>
+    void for_each(Visitor visitor) const {
+        for (const auto& shard: shards_) {
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            for (auto iter = shard->map.begin(); iter != shard->map.end(); ++iter) {
+                visitor(iter->first, static_cast<const Value&>(iter->second));
+            }
+        }
+    }
+
+    // Exact only while no other thread modifies the map.
+    size_t size() const {
+        size_t result = 0;
+        for (const auto& shard: shards_) {
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            result += shard->map.size();
+        }
+        return result;
+    }
+
+    void clear() {
+        for (const auto& shard: shards_) {
+            std::unique_lock<std::shared_mutex> lock(shard->mutex);
+            shard->map.clear();
+        }
     }
 };
 
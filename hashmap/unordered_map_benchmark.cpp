@@ -0,0 +1,586 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <random>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <thread>
+
+#include "unordered_map.h"
+
+constexpr int ELEMENTS = 1'000'000;
+
+template <typename Func>
+long long Measure(Func&& func) {
+    using namespace std::chrono;
+
+    auto start = high_resolution_clock::now();
+    func();
+    auto finish = high_resolution_clock::now();
+    return duration_cast<milliseconds>(finish - start).count();
+}
+
+template <typename Func>
+void Report(const std::string& name, Func&& func) {
+    std::ostringstream oss;
+    for (int i = 0; i < 3; ++i) {
+        oss << Measure(func) << " ";
+    }
+    std::cerr << " " << name << ": " << oss.str() << "ms" << std::endl;
+}
+
+template <typename Key, typename Value>
+using ChainedMap = UnorderedMap<Key, Value>;
+
+template <typename Key, typename Value>
+using SwissMap = UnorderedMap<Key, Value, std::hash<Key>, std::equal_to<Key>,
+                              std::allocator<std::pair<const Key, Value>>, SwissLayout>;
+
+template <typename Key, typename Value>
+using RobinHoodMap = UnorderedMap<Key, Value, std::hash<Key>, std::equal_to<Key>,
+                                  std::allocator<std::pair<const Key, Value>>, RobinHoodLayout>;
+
+// Distinct random keys in random order.
+std::vector<int> ShuffledKeys(int count, unsigned seed) {
+    std::vector<int> keys(count);
+    std::mt19937 rng(seed);
+    for (int& key: keys) {
+        key = static_cast<int>(rng());
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+// Keys are random, so that neither engine profits from the identity hash of
+// sequential integers, and lookups come in a different order than inserts.
+template <typename Map>
+void RunWorkloads(const std::string& name) {
+    std::vector<int> keys = ShuffledKeys(ELEMENTS, 1);
+    std::vector<int> missing = ShuffledKeys(ELEMENTS, 2);
+    std::vector<int> lookups(keys);
+    std::shuffle(lookups.begin(), lookups.end(), std::mt19937(3));
+
+    std::cerr << name << ":" << std::endl;
+
+    Report("insert", [&] {
+        Map map;
+        for (int key: keys) {
+            map[key] = key;
+        }
+    });
+
+    Map map;
+    for (int key: keys) {
+        map.emplace(key, key);
+    }
+
+    Report("find hit", [&] {
+        long long sum = 0;
+        for (int key: lookups) {
+            sum += map.find(key)->second;
+        }
+        assert(sum != 1);
+    });
+
+    Report("find miss", [&] {
+        size_t found = 0;
+        for (int key: missing) {
+            found += map.find(key) != map.end() ? 1 : 0;
+        }
+        assert(found < keys.size());
+    });
+
+    Report("iterate", [&] {
+        long long sum = 0;
+        for (const auto& kv: map) {
+            sum += kv.second;
+        }
+        assert(sum != 1);
+    });
+
+    Report("erase and reinsert", [&] {
+        for (size_t i = 0; i < lookups.size(); i += 2) {
+            map.erase(map.find(lookups[i]));
+        }
+        for (size_t i = 0; i < lookups.size(); i += 2) {
+            map.emplace(lookups[i], lookups[i]);
+        }
+    });
+}
+
+void BenchmarkIntKeys() {
+    RunWorkloads<std::unordered_map<int, int>>("std::unordered_map");
+    RunWorkloads<ChainedMap<int, int>>("UnorderedMap, ChainedLayout");
+    RunWorkloads<SwissMap<int, int>>("UnorderedMap, SwissLayout");
+    RunWorkloads<RobinHoodMap<int, int>>("UnorderedMap, RobinHoodLayout");
+}
+
+template <typename Map>
+void RunStringLookups(const std::string& name, const std::vector<std::string>& keys) {
+    Map map;
+    for (const auto& key: keys) {
+        map[key] = 1;
+    }
+    Report(name, [&] {
+        int sum = 0;
+        for (const auto& key: keys) {
+            sum += map.find(key)->second;
+        }
+        assert(sum == static_cast<int>(map.size()));
+    });
+}
+
+void BenchmarkStringKeys() {
+    std::vector<std::string> keys;
+    for (int key: ShuffledKeys(ELEMENTS / 4, 4)) {
+        keys.push_back("key-" + std::to_string(key));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(5));
+
+    RunStringLookups<std::unordered_map<std::string, int>>("std::unordered_map", keys);
+    RunStringLookups<ChainedMap<std::string, int>>("UnorderedMap, ChainedLayout", keys);
+    RunStringLookups<SwissMap<std::string, int>>("UnorderedMap, SwissLayout", keys);
+}
+
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view key) const {
+        return std::hash<std::string_view>()(key);
+    }
+};
+
+struct StringEqual {
+    using is_transparent = void;
+
+    bool operator()(std::string_view x, std::string_view y) const {
+        return x == y;
+    }
+};
+
+// Word counting: a few thousand distinct words, a million increments, so
+// nearly every access hits an existing key.
+template <typename Map>
+void RunHitHeavy(const std::string& name, const std::vector<std::string>& words) {
+    std::cerr << name << ":" << std::endl;
+
+    Report("emplace(word, 0)", [&] {
+        Map map;
+        for (const auto& word: words) {
+            ++map.emplace(word, 0).first->second;
+        }
+    });
+
+    Report("operator[]", [&] {
+        Map map;
+        for (const auto& word: words) {
+            ++map[word];
+        }
+    });
+
+    Report("try_emplace", [&] {
+        Map map;
+        for (const auto& word: words) {
+            ++map.try_emplace(word, 0).first->second;
+        }
+    });
+
+    Report("operator[] with string_view", [&] {
+        Map map;
+        for (const auto& word: words) {
+            ++map[std::string_view(word)];
+        }
+    });
+}
+
+void BenchmarkHitHeavy() {
+    std::vector<std::string> words;
+    std::mt19937 rng(6);
+    for (int i = 0; i < ELEMENTS; ++i) {
+        words.push_back("a-rather-long-word-number-" + std::to_string(rng() % 4'000));
+    }
+
+    using Alloc = std::allocator<std::pair<const std::string, int>>;
+    RunHitHeavy<UnorderedMap<std::string, int, StringHash, StringEqual, Alloc, ChainedLayout>>(
+        "UnorderedMap, ChainedLayout", words);
+    RunHitHeavy<UnorderedMap<std::string, int, StringHash, StringEqual, Alloc, SwissLayout>>(
+        "UnorderedMap, SwissLayout", words);
+}
+
+// Times every insert on its own: a stop-the-world rehash shows up in the tail,
+// not in the total.
+template <typename Map, typename Setup>
+void RunInsertLatency(const std::string& name, const std::vector<int>& keys, Setup setup) {
+    using namespace std::chrono;
+
+    std::vector<long long> latencies;
+    latencies.reserve(keys.size());
+    Map map;
+    setup(map);
+    auto start = steady_clock::now();
+    for (int key: keys) {
+        auto before = steady_clock::now();
+        map.emplace(key, key);
+        latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - before).count());
+    }
+    long long total = duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+    };
+    std::cerr << " " << name << ": p50 " << percentile(0.5) << " ns, p99 " << percentile(0.99)
+              << " ns, p999 " << percentile(0.999) << " ns, max " << latencies.back() / 1'000'000
+              << " ms, total " << total << " ms" << std::endl;
+}
+
+void BenchmarkInsertLatency() {
+    std::vector<int> keys = ShuffledKeys(4 * ELEMENTS, 7);
+    auto nothing = [](auto&) {};
+
+    RunInsertLatency<std::unordered_map<int, int>>("std::unordered_map", keys, nothing);
+    RunInsertLatency<ChainedMap<int, int>>("UnorderedMap, rehash all at once", keys, nothing);
+    RunInsertLatency<ChainedMap<int, int>>("UnorderedMap, set_rehash_step(4)", keys,
+                                           [](auto& map) { map.set_rehash_step(4); });
+}
+
+template <typename Key, typename Value, typename RehashPolicy>
+using PolicyMap = UnorderedMap<Key, Value, std::hash<Key>, std::equal_to<Key>,
+                               std::allocator<std::pair<const Key, Value>>, ChainedLayout,
+                               RehashPolicy>;
+
+// Multiples of 4096: their low twelve bits are zero, so without mixing a
+// power-of-two table puts them all into one bucket in 4096. Growth by doubling
+// from one bucket makes the modulo policy's counts powers of two as well, so it
+// is hit just as hard; hence the small count.
+template <typename Map>
+void RunStridedKeys(const std::string& name) {
+    Report(name, [] {
+        Map map;
+        for (int i = 0; i < ELEMENTS / 16; ++i) {
+            map.emplace(i * 4096, i);
+        }
+        long long sum = 0;
+        for (int i = 0; i < ELEMENTS / 16; ++i) {
+            sum += map.find(i * 4096)->second;
+        }
+        assert(sum != 1);
+    });
+}
+
+void BenchmarkRehashPolicies() {
+    RunWorkloads<PolicyMap<int, int, ModuloRehashPolicy>>("ModuloRehashPolicy");
+    RunWorkloads<PolicyMap<int, int, PowerOfTwoRehashPolicy>>("PowerOfTwoRehashPolicy");
+    RunWorkloads<PolicyMap<int, int, FastRangeRehashPolicy>>("FastRangeRehashPolicy");
+
+    std::cerr << "Strided keys, insert and find:" << std::endl;
+    RunStridedKeys<PolicyMap<int, int, ModuloRehashPolicy>>("ModuloRehashPolicy");
+    RunStridedKeys<PolicyMap<int, int, PowerOfTwoRehashPolicy>>("PowerOfTwoRehashPolicy");
+    RunStridedKeys<PolicyMap<int, int, FastRangeRehashPolicy>>("FastRangeRehashPolicy");
+}
+
+using GrowthMap = PolicyMap<int, int, ModuloRehashPolicy>;
+
+void RunGrowFromEmpty(const std::string& name, const ModuloRehashPolicy& policy,
+                      const std::vector<int>& keys, bool reserve = false) {
+    Report(name, [&] {
+        GrowthMap map(policy);
+        if (reserve) {
+            map.reserve(keys.size());
+        }
+        for (int key: keys) {
+            map.emplace(key, key);
+        }
+    });
+}
+
+void BenchmarkGrowFromEmpty() {
+    std::vector<int> keys = ShuffledKeys(ELEMENTS, 8);
+    ModuloRehashPolicy policy;
+
+    ModuloRehashPolicy one_bucket = policy;
+    one_bucket.initial_bucket_count = 1;
+    RunGrowFromEmpty("1 initial bucket, growth 2 (the old behaviour)", one_bucket, keys);
+    RunGrowFromEmpty("16 initial buckets, growth 2 (default)", policy, keys);
+
+    ModuloRehashPolicy factor_four = policy;
+    factor_four.growth_factor = 4;
+    RunGrowFromEmpty("16 initial buckets, growth 4", factor_four, keys);
+
+    RunGrowFromEmpty("reserve() up front", policy, keys, true);
+}
+
+// Fills the map to a million elements and erases it down to ten thousand, over
+// and over. Without shrinking, the bucket array stays sized for the peak.
+void RunChurn(const std::string& name, const ModuloRehashPolicy& policy,
+              const std::vector<int>& keys) {
+    size_t low_buckets = 0;
+    Report(name, [&] {
+        GrowthMap map(policy);
+        for (int round = 0; round < 3; ++round) {
+            for (int key: keys) {
+                map.emplace(key, key);
+            }
+            for (size_t i = 10'000; i < keys.size(); ++i) {
+                map.erase(map.find(keys[i]));
+            }
+            low_buckets = map.bucket_count();
+        }
+    });
+    std::cerr << "   buckets after erasing: " << low_buckets << std::endl;
+}
+
+void BenchmarkChurn() {
+    std::vector<int> keys = ShuffledKeys(ELEMENTS, 9);
+    ModuloRehashPolicy policy;
+    RunChurn("never shrink (default)", policy, keys);
+
+    ModuloRehashPolicy shrinking = policy;
+    shrinking.min_load_factor = 0.125;
+    RunChurn("min_load_factor 0.125", shrinking, keys);
+}
+
+// What ConcurrentUnorderedMap replaces: one map behind one mutex.
+class LockedMap {
+private:
+    std::mutex mutex_;
+    ChainedMap<int, long long> map_;
+
+public:
+    void insert_or_update(int key, long long value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [iter, inserted] = map_.try_emplace(key, value);
+        if (!inserted) {
+            iter->second += value;
+        }
+    }
+
+    bool contains(int key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return map_.find(key) != map_.end();
+    }
+};
+
+class ShardedMap {
+private:
+    ConcurrentUnorderedMap<int, long long> map_;
+
+public:
+    void insert_or_update(int key, long long value) {
+        map_.insert_or_update(key, value, [value](long long& current) { current += value; });
+    }
+
+    bool contains(int key) {
+        return map_.contains(key);
+    }
+};
+
+// ELEMENTS operations split between the threads, writes_per_100 of every
+// hundred being updates and the rest lookups, over 100K keys.
+template <typename Map>
+void RunConcurrentMix(const std::string& name, int writes_per_100) {
+    constexpr int KEYS = 100'000;
+    std::ostringstream oss;
+    for (int threads: {1, 2, 4, 8, 16, 32, 64}) {
+        Map map;
+        for (int key = 0; key < KEYS; key += 2) {
+            map.insert_or_update(key, 1);
+        }
+        long long time = Measure([&] {
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; ++t) {
+                workers.emplace_back([&map, t, threads, writes_per_100] {
+                    std::mt19937 rng(t);
+                    size_t found = 0;
+                    for (int i = 0; i < ELEMENTS / threads; ++i) {
+                        int key = static_cast<int>(rng() % KEYS);
+                        if (static_cast<int>(rng() % 100) < writes_per_100) {
+                            map.insert_or_update(key, 1);
+                        } else {
+                            found += map.contains(key) ? 1 : 0;
+                        }
+                    }
+                    assert(found <= static_cast<size_t>(ELEMENTS));
+                });
+            }
+            for (auto& worker: workers) {
+                worker.join();
+            }
+        });
+        oss << threads << ":" << time << " ";
+    }
+    std::cerr << " " << name << ": " << oss.str() << "(threads:ms)" << std::endl;
+}
+
+void BenchmarkConcurrentMaps() {
+    std::cerr << " hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+    std::cerr << "Read-mostly, 5% updates:" << std::endl;
+    RunConcurrentMix<LockedMap>("UnorderedMap behind a mutex", 5);
+    RunConcurrentMix<ShardedMap>("ConcurrentUnorderedMap", 5);
+    std::cerr << "Write-heavy, 50% updates:" << std::endl;
+    RunConcurrentMix<LockedMap>("UnorderedMap behind a mutex", 50);
+    RunConcurrentMix<ShardedMap>("ConcurrentUnorderedMap", 50);
+}
+
+// Eight million elements are far more than any cache holds, so nearly every
+// lookup misses it; half of the looked up keys are absent.
+template <typename Map>
+void RunBatchLookup(const std::string& name) {
+    std::vector<int> keys = ShuffledKeys(16 * ELEMENTS, 17);
+    Map map;
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        map.emplace(keys[i], static_cast<int>(i));
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(18));
+    std::vector<char> present(keys.size());
+
+    Report(name + ", contains one by one", [&] {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            present[i] = map.contains(keys[i]);
+        }
+    });
+    Report(name + ", contains_batch", [&] {
+        map.contains_batch(keys.begin(), keys.end(), present.begin());
+    });
+}
+
+void BenchmarkBatchLookup() {
+    RunBatchLookup<ChainedMap<int, int>>("UnorderedMap");
+    RunBatchLookup<SwissMap<int, int>>("UnorderedMap<SwissLayout>");
+}
+
+// Building from 8M pairs one emplace at a time rehashes every time the table
+// doubles; insert(first, last) sizes it once, and insert_parallel also hashes
+// and links in parallel.
+void BenchmarkBulkBuild() {
+    std::vector<int> keys = ShuffledKeys(8 * ELEMENTS, 19);
+    std::vector<std::pair<int, int>> pairs;
+    pairs.reserve(keys.size());
+    for (int key: keys) {
+        pairs.emplace_back(key, key);
+    }
+
+    Report("emplace one by one", [&] {
+        ChainedMap<int, int> map;
+        for (const auto& pair: pairs) {
+            map.emplace(pair);
+        }
+    });
+    Report("insert(first, last)", [&] {
+        ChainedMap<int, int> map;
+        map.insert(pairs.begin(), pairs.end());
+    });
+
+    std::ostringstream build;
+    std::ostringstream rehash;
+    for (size_t threads: {1, 2, 4, 8, 16}) {
+        ChainedMap<int, int> map;
+        build << threads << ":" << Measure([&] {
+            map.insert_parallel(pairs.begin(), pairs.end(), threads);
+        }) << " ";
+        rehash << threads << ":" << Measure([&] {
+            map.rehash_parallel(2 * map.bucket_count(), threads);
+        }) << " ";
+    }
+    std::cerr << " insert_parallel: " << build.str() << "(threads:ms)" << std::endl;
+    std::cerr << " rehash_parallel to twice the buckets: " << rehash.str() << "(threads:ms)"
+              << std::endl;
+    ChainedMap<int, int> map;
+    map.insert(pairs.begin(), pairs.end());
+    Report("rehash to twice the buckets", [&] {
+        map.rehash(2 * map.bucket_count());
+    });
+}
+
+// Nine lookups in ten miss, first in a freshly built map and then after
+// rounds of erasing and reinserting a tenth of the keys, which leave
+// tombstones in the Swiss table but not in the Robin Hood one.
+template <typename Map>
+void RunMissHeavy(const std::string& name) {
+    std::vector<int> keys = ShuffledKeys(2 * ELEMENTS, 20);
+    std::vector<int> present(keys.begin(), keys.begin() + ELEMENTS / 2);
+    std::vector<int> lookups;
+    for (int i = 0; i < 10 * ELEMENTS; ++i) {
+        lookups.push_back(i % 10 == 0 ? present[i / 10 % present.size()] : keys[i % keys.size()]);
+    }
+    std::shuffle(lookups.begin(), lookups.end(), std::mt19937(21));
+
+    Map map;
+    for (int key: present) {
+        map.emplace(key, key);
+    }
+    auto lookup = [&] {
+        size_t found = 0;
+        for (int key: lookups) {
+            found += map.find(key) != map.end() ? 1 : 0;
+        }
+        assert(found >= lookups.size() / 10);
+    };
+    Report(name + ", fresh", lookup);
+    for (int round = 0; round < 10; ++round) {
+        for (size_t i = round; i < present.size(); i += 10) {
+            map.erase(map.find(present[i]));
+        }
+        for (size_t i = round; i < present.size(); i += 10) {
+            map.emplace(present[i], present[i]);
+        }
+    }
+    Report(name + ", after churn", lookup);
+    if constexpr (std::is_same_v<Map, RobinHoodMap<int, int>>) {
+        auto stats = map.probe_stats();
+        std::cerr << " probe length: mean " << stats.mean << ", variance " << stats.variance
+                  << ", longest " << stats.longest << std::endl;
+    }
+}
+
+void BenchmarkMissHeavy() {
+    RunMissHeavy<std::unordered_map<int, int>>("std::unordered_map");
+    RunMissHeavy<ChainedMap<int, int>>("UnorderedMap, ChainedLayout");
+    RunMissHeavy<SwissMap<int, int>>("UnorderedMap, SwissLayout");
+    RunMissHeavy<RobinHoodMap<int, int>>("UnorderedMap, RobinHoodLayout");
+}
+
+int main() {
+    std::cerr << "Integer keys:" << std::endl;
+    BenchmarkIntKeys();
+
+    std::cerr << "String keys, find hit:" << std::endl;
+    BenchmarkStringKeys();
+
+    std::cerr << "Hit-heavy updates:" << std::endl;
+    BenchmarkHitHeavy();
+
+    std::cerr << "Insert latency, growing from empty:" << std::endl;
+    BenchmarkInsertLatency();
+
+    std::cerr << "Bucket index reduction of the chained engine:" << std::endl;
+    BenchmarkRehashPolicies();
+
+    std::cerr << "Growing from empty:" << std::endl;
+    BenchmarkGrowFromEmpty();
+
+    std::cerr << "Churn between 1M and 10K elements:" << std::endl;
+    BenchmarkChurn();
+
+    std::cerr << "Shared between threads:" << std::endl;
+    BenchmarkConcurrentMaps();
+
+    std::cerr << "Lookups in 8M elements:" << std::endl;
+    BenchmarkBatchLookup();
+
+    std::cerr << "Building from 8M pairs, " << std::thread::hardware_concurrency()
+              << " hardware threads:" << std::endl;
+    BenchmarkBulkBuild();
+
+    std::cerr << "Miss-heavy lookups in 500K elements:" << std::endl;
+    BenchmarkMissHeavy();
+}
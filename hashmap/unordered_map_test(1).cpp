@@ -3,7 +3,15 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <optional>
 #include <iterator>
+#include <list>
 #include <cassert>
 
 #include <iostream>
@@ -397,19 +405,737 @@ void TestCustomAlloc() {
     }    
 }
 
+struct FlakyHash {
+    static inline int calls_left = -1;
+
+    size_t operator()(int key) const {
+        if (calls_left >= 0 && calls_left-- == 0) {
+            throw std::runtime_error("hash failed");
+        }
+        return std::hash<int>()(key);
+    }
+};
+
+struct FlakyCopy {
+    static inline int copies_left = -1;
+    static inline int alive = 0;
+
+    int x;
+
+    explicit FlakyCopy(int x): x(x) {
+        ++alive;
+    }
+
+    FlakyCopy(const FlakyCopy& other): x(other.x) {
+        if (copies_left >= 0 && copies_left-- == 0) {
+            throw std::runtime_error("copy failed");
+        }
+        ++alive;
+    }
+
+    ~FlakyCopy() {
+        --alive;
+    }
+};
+
+void TestSwissLayout() {
+    UnorderedMap<int, int, std::hash<int>, std::equal_to<int>,
+        std::allocator<std::pair<const int, int>>, SwissLayout> m;
+    for (int i = 0; i < 100'000; ++i) {
+        m[i] = i;
+    }
+    for (int i = 0; i < 100'000; i += 2) {
+        m.erase(m.find(i));
+    }
+    assert(m.size() == 50'000);
+    for (int i = 0; i < 100'000; ++i) {
+        assert((m.find(i) == m.end()) == (i % 2 == 0));
+    }
+    long long sum = 0;
+    for (const auto& kv: m) {
+        assert(kv.first == kv.second);
+        sum += kv.second;
+    }
+    assert(sum == 2'500'000'000LL);
+
+    UnorderedMap<NeitherDefaultNorCopyConstructible, NeitherDefaultNorCopyConstructible,
+        std::hash<NeitherDefaultNorCopyConstructible>, std::equal_to<NeitherDefaultNorCopyConstructible>,
+        std::allocator<std::pair<const NeitherDefaultNorCopyConstructible,
+                                 NeitherDefaultNorCopyConstructible>>, SwissLayout> special;
+    for (int i = 0; i < 1'000; ++i) {
+        special.emplace(VerySpecialType(i), VerySpecialType(i));
+    }
+    special.at(VerySpecialType(7)) = VerySpecialType(0);
+    assert(special.at(VerySpecialType(7)).x.x == 0);
+
+    UnorderedMap<Chaste, Chaste, std::hash<Chaste>, std::equal_to<Chaste>,
+        TheChosenOne<std::pair<const Chaste, Chaste>>, SwissLayout> chaste;
+    for (int i = 0; i < 100'000; ++i) {
+        chaste.emplace(i, i);
+    }
+    {
+        auto copy = chaste;
+        copy.reserve(1'000'000);
+        copy.erase(copy.begin());
+        assert(copy.size() == 99'999);
+    }
+    while (chaste.size() > 0) {
+        chaste.erase(chaste.begin());
+    }
+
+    // A hash or a copy that throws while growing leaves the table as it was.
+    UnorderedMap<int, std::string, FlakyHash, std::equal_to<int>,
+        std::allocator<std::pair<const int, std::string>>, SwissLayout> names;
+    for (int i = 0; i < 100; ++i) {
+        names.emplace(i, std::to_string(i));
+    }
+    size_t buckets = names.bucket_count();
+    FlakyHash::calls_left = 50;
+    bool thrown = false;
+    try {
+        names.reserve(10'000);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    FlakyHash::calls_left = -1;
+    assert(thrown && names.size() == 100 && names.bucket_count() == buckets);
+    for (int i = 0; i < 100; ++i) {
+        assert(names.at(i) == std::to_string(i));
+    }
+
+    {
+        UnorderedMap<int, FlakyCopy, std::hash<int>, std::equal_to<int>,
+            std::allocator<std::pair<const int, FlakyCopy>>, SwissLayout> values;
+        for (int i = 0; i < 100; ++i) {
+            values.emplace(i, FlakyCopy(i));
+        }
+        FlakyCopy::copies_left = 50;
+        thrown = false;
+        try {
+            values.reserve(10'000);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        FlakyCopy::copies_left = -1;
+        assert(thrown && values.size() == 100 && FlakyCopy::alive == 100);
+        for (int i = 0; i < 100; ++i) {
+            assert(values.at(i).x == i);
+        }
+        values.reserve(10'000);
+        assert(values.size() == 100 && FlakyCopy::alive == 100);
+    }
+    assert(FlakyCopy::alive == 0);
+}
+
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view key) const {
+        return std::hash<std::string_view>()(key);
+    }
+};
+
+struct StringEqual {
+    using is_transparent = void;
+
+    bool operator()(std::string_view x, std::string_view y) const {
+        return x == y;
+    }
+};
+
+struct CountedValue {
+    static inline int constructed = 0;
+
+    int x = 0;
+
+    CountedValue() {
+        ++constructed;
+    }
+
+    explicit CountedValue(int x): x(x) {
+        ++constructed;
+    }
+
+    CountedValue(const CountedValue& other): x(other.x) {
+        ++constructed;
+    }
+
+    CountedValue(CountedValue&& other) noexcept: x(other.x) {
+        ++constructed;
+    }
+
+    CountedValue& operator=(const CountedValue&) = default;
+};
+
+struct CountedKey {
+    static inline int constructed = 0;
+
+    std::string name;
+
+    CountedKey(std::string_view name): name(name) {
+        ++constructed;
+    }
+
+    CountedKey(const CountedKey& other): name(other.name) {
+        ++constructed;
+    }
+
+    CountedKey(CountedKey&& other) noexcept: name(std::move(other.name)) {
+        ++constructed;
+    }
+
+    operator std::string_view() const {
+        return name;
+    }
+};
+
+template <typename Layout>
+void TestTryEmplaceAndTransparentLookupWith() {
+    UnorderedMap<std::string, CountedValue, StringHash, StringEqual,
+        std::allocator<std::pair<const std::string, CountedValue>>, Layout> m;
+
+    assert(m.try_emplace("one", 1).second);
+    CountedValue::constructed = 0;
+    auto [it, inserted] = m.try_emplace("one", 2);
+    assert(!inserted && it->second.x == 1);
+    assert(CountedValue::constructed == 0);
+
+    ++m[std::string_view("one")].x;
+    ++m["one"].x;
+    assert(CountedValue::constructed == 0);
+    assert(m.at(std::string_view("one")).x == 3);
+
+    std::string moved = "two";
+    assert(m.insert_or_assign(std::move(moved), CountedValue(4)).second);
+    assert(!m.insert_or_assign("two", CountedValue(5)).second);
+    assert(m.at("two").x == 5);
+    assert(m.size() == 2);
+
+    const auto& cm = m;
+    assert(cm.at(std::string("two")).x == 5);
+    assert(cm.find(std::string_view("three")) == m.end());
+    assert(cm.contains("one") && !cm.contains("three"));
+    try {
+        cm.at("three");
+        assert(false);
+    } catch (const std::out_of_range&) {}
+
+    // A hit must not move from its arguments.
+    std::string key = "one";
+    CountedValue value(7);
+    m.try_emplace(std::move(key), value);
+    assert(key == "one");
+
+    UnorderedMap<CountedKey, int, StringHash, StringEqual,
+        std::allocator<std::pair<const CountedKey, int>>, Layout> keyed;
+    keyed.emplace(CountedKey("one"), 1);
+    CountedKey::constructed = 0;
+    const auto& ckeyed = keyed;
+    assert(ckeyed.contains(std::string_view("one")));
+    assert(!ckeyed.contains(std::string_view("two")));
+    assert(ckeyed.find(std::string_view("one"))->second == 1);
+    assert(CountedKey::constructed == 0);
+}
+
+void TestTryEmplaceAndTransparentLookup() {
+    TestTryEmplaceAndTransparentLookupWith<ChainedLayout>();
+    TestTryEmplaceAndTransparentLookupWith<SwissLayout>();
+    TestTryEmplaceAndTransparentLookupWith<RobinHoodLayout>();
+}
+
+void TestIncrementalRehash() {
+    UnorderedMap<int, int> m;
+    m.set_rehash_step(2);
+    m[-1] = -1;
+    int* stable = &m[-1];
+    for (int i = 0; i < 100'000; ++i) {
+        m[i] = i;
+        if (i % 3 == 0) {
+            m.erase(m.find(i / 2));
+        }
+        if (i % 1'000 == 0) {
+            for (int j = i / 2 + 1; j <= i; j += 97) {
+                assert(m.find(j) != m.end() && m.at(j) == j);
+            }
+        }
+    }
+    assert(*stable == -1 && &m.at(-1) == stable);
+
+    size_t count = 0;
+    for (const auto& kv: m) {
+        assert(m.at(kv.first) == kv.second);
+        ++count;
+    }
+    assert(count == m.size());
+
+    auto moved = std::move(m);
+    moved.set_rehash_step(0);
+    for (int i = 100'000; i < 200'000; ++i) {
+        moved[i] = i;
+    }
+    assert(moved.at(-1) == -1 && moved.at(150'000) == 150'000);
+}
+
+template <typename RehashPolicy>
+void TestRehashPolicy() {
+    UnorderedMap<int, int, std::hash<int>, std::equal_to<int>,
+        std::allocator<std::pair<const int, int>>, ChainedLayout, RehashPolicy> m(10);
+    for (int i = 0; i < 50'000; ++i) {
+        m[i * 1031] = i;
+    }
+    m.set_rehash_step(1);
+    for (int i = 50'000; i < 100'000; ++i) {
+        m[i * 1031] = i;
+    }
+    for (int i = 0; i < 100'000; i += 2) {
+        m.erase(m.find(i * 1031));
+    }
+    assert(m.size() == 50'000);
+    for (int i = 0; i < 100'000; ++i) {
+        assert((m.find(i * 1031) == m.end()) == (i % 2 == 0));
+    }
+    m.reserve(1'000'000);
+    assert(m.at(99'999 * 1031) == 99'999);
+}
+
+void TestRehashPolicies() {
+    TestRehashPolicy<ModuloRehashPolicy>();
+    TestRehashPolicy<PowerOfTwoRehashPolicy>();
+    TestRehashPolicy<FastRangeRehashPolicy>();
+}
+
+void TestGrowthPolicy() {
+    PowerOfTwoRehashPolicy policy;
+    policy.initial_bucket_count = 64;
+    policy.growth_factor = 4;
+    policy.min_load_factor = 0.1;
+    UnorderedMap<int, int, std::hash<int>, std::equal_to<int>,
+        std::allocator<std::pair<const int, int>>, ChainedLayout, PowerOfTwoRehashPolicy> m(policy);
+    assert(m.bucket_count() == 64);
+    for (int i = 0; i < 64; ++i) {
+        m[i] = i;
+    }
+    assert(m.bucket_count() == 64);
+    m[64] = 64;
+    assert(m.bucket_count() == 256);
+    for (int i = 65; i < 100'000; ++i) {
+        m[i] = i;
+    }
+    size_t grown = m.bucket_count();
+    assert(m.load_factor() <= m.max_load_factor());
+
+    // Erasing most elements shrinks the table, but not below the initial count.
+    for (int i = 0; i < 99'000; ++i) {
+        m.erase(m.find(i));
+    }
+    assert(m.bucket_count() < grown);
+    size_t shrunk = m.bucket_count();
+    assert(m.load_factor() > 0.1);
+
+    // Right after a shrink, a few inserts and erasures don't rehash again.
+    for (int i = 0; i < 100; ++i) {
+        m[i] = i;
+        m.erase(m.find(i));
+    }
+    assert(m.bucket_count() == shrunk);
+    for (int i = 99'000; i < 100'000; ++i) {
+        assert(m.at(i) == i);
+    }
+    m.erase(m.begin(), m.end());
+    assert(m.size() == 0 && m.bucket_count() == 64);
+
+    m.max_load_factor(0.5);
+    m.reserve(1'000);
+    assert(m.bucket_count() >= 2'000);
+    assert(m.max_size() > 0 && m.max_size() < static_cast<size_t>(-1));
+
+    // Policies that could never make room are rejected and leave the map as is.
+    PowerOfTwoRehashPolicy stuck = policy;
+    stuck.growth_factor = 1;
+    bool thrown = false;
+    try {
+        m.set_rehash_policy(stuck);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown && m.rehash_policy().growth_factor == 4);
+    thrown = false;
+    try {
+        m.max_load_factor(0.0);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown && m.max_load_factor() == 0.5);
+    stuck = policy;
+    stuck.max_load_factor = -1.0;
+    thrown = false;
+    try {
+        UnorderedMap<int, int, std::hash<int>, std::equal_to<int>,
+            std::allocator<std::pair<const int, int>>, ChainedLayout, PowerOfTwoRehashPolicy> bad(stuck);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void TestConcurrentMap() {
+    ConcurrentUnorderedMap<int, long long> m(8);
+    assert(m.shard_count() == 8);
+
+    constexpr int THREADS = 4;
+    constexpr int KEYS = 1'000;
+    constexpr int ROUNDS = 20;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&m, t] {
+            for (int round = 0; round < ROUNDS; ++round) {
+                for (int key = 0; key < KEYS; ++key) {
+                    m.insert_or_update(key, 1, [](long long& value) { ++value; });
+                    m.compute(-key - 1, [t](std::optional<long long>& value) {
+                        value = value.value_or(0) + t;
+                    });
+                    m.visit(key, [](long long value) { assert(value >= 1); });
+                }
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    assert(m.size() == 2 * KEYS);
+    for (int key = 0; key < KEYS; ++key) {
+        assert(m.find(key) == THREADS * ROUNDS);
+        assert(m.find(-key - 1) == ROUNDS * (0 + 1 + 2 + 3));
+    }
+    long long total = 0;
+    m.for_each([&total](int, long long value) { total += value; });
+    assert(total == static_cast<long long>(KEYS) * ROUNDS * (THREADS + 6));
+
+    m.compute(0, [](std::optional<long long>& value) { value.reset(); });
+    assert(!m.contains(0) && !m.find(0));
+    assert(m.erase(1) && !m.erase(1));
+    assert(m.insert(1, 5) && !m.insert(1, 6) && m.find(1) == 5);
+
+    // A throwing callback leaves the old value in place.
+    ConcurrentUnorderedMap<int, std::string> names;
+    names.insert(1, "one");
+    bool thrown = false;
+    try {
+        names.compute(1, [](std::optional<std::string>& value) {
+            if (value->size() == 3) {
+                throw std::runtime_error("compute failed");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown && names.find(1) == std::string("one"));
+}
+
+template <typename Map>
+void CheckBatchLookup(Map& m) {
+    std::vector<int> keys;
+    for (int i = -50; i < 1'050; ++i) {
+        keys.push_back(i * 7);
+    }
+    std::vector<typename Map::Iterator> found;
+    m.find_batch(keys.begin(), keys.end(), std::back_inserter(found));
+    std::vector<char> present(keys.size());
+    auto end = m.contains_batch(keys.begin(), keys.end(), present.begin());
+    assert(end == present.end() && found.size() == keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        assert(found[i] == m.find(keys[i]));
+        assert(static_cast<bool>(present[i]) == m.contains(keys[i]));
+        assert(present[i] == (keys[i] >= 0 && keys[i] < 7'000));
+    }
+    found.clear();
+    m.find_batch(keys.begin(), keys.begin(), std::back_inserter(found));
+    assert(found.empty());
+}
+
+void TestBatchLookup() {
+    UnorderedMap<int, int> chained;
+    UnorderedMap<int, int, std::hash<int>, std::equal_to<int>,
+        std::allocator<std::pair<const int, int>>, SwissLayout> swiss;
+    for (int i = 0; i < 1'000; ++i) {
+        chained[i * 7] = i;
+        swiss[i * 7] = i;
+    }
+    CheckBatchLookup(chained);
+    CheckBatchLookup(swiss);
+
+    // Halfway through an incremental rehash keys may still be in the old table.
+    UnorderedMap<int, int> growing;
+    growing.set_rehash_step(1);
+    for (int i = 0; i < 1'000; ++i) {
+        growing[i * 7] = i;
+    }
+    CheckBatchLookup(growing);
+}
+
+template <typename Map>
+void CheckAgainst(Map& m, const std::vector<std::pair<int, int>>& expected) {
+    assert(m.size() == expected.size());
+    for (const auto& [key, value]: expected) {
+        assert(m.at(key) == value);
+    }
+    size_t walked = 0;
+    for (auto it = m.begin(); it != m.end(); ++it) {
+        ++walked;
+    }
+    assert(walked == expected.size());
+    assert(m.load_factor() <= m.max_load_factor());
+}
+
+void TestParallelBuild() {
+    // Keys 0 .. 149'999, a third of them twice; the first copy has to win,
+    // as must the elements that were there before.
+    std::vector<std::pair<int, int>> pairs;
+    for (int i = 0; i < 150'000; ++i) {
+        pairs.emplace_back(i, i);
+        if (i % 3 == 0) {
+            pairs.emplace_back(i, -i);
+        }
+    }
+    std::vector<std::pair<int, int>> expected;
+    UnorderedMap<int, int> m;
+    for (int i = 0; i < 20'000; i += 2) {
+        m[i] = 1;
+    }
+    for (int i = 0; i < 150'000; ++i) {
+        expected.emplace_back(i, i < 20'000 && i % 2 == 0 ? 1 : i);
+    }
+    m.insert_parallel(pairs.begin(), pairs.end(), 4);
+    CheckAgainst(m, expected);
+
+    UnorderedMap<int, int> built;
+    built.insert_parallel(pairs.begin(), pairs.end(), 3);
+    size_t buckets = built.bucket_count();
+    assert(built.size() == 150'000);
+    built.rehash_parallel(4 * buckets, 4);
+    assert(built.bucket_count() >= 4 * buckets);
+    built.rehash_parallel(0, 4);
+    assert(built.bucket_count() < buckets);
+    for (int i = 0; i < 1'000; ++i) {
+        built.erase(built.find(i));
+        built[-i - 1] = i;
+    }
+    for (int i = 0; i < 150'000; ++i) {
+        assert(built.contains(i) == (i >= 1'000));
+    }
+
+    // A rehash in progress is finished first; a list can't be split up, so it
+    // is inserted one element at a time.
+    UnorderedMap<int, int> growing;
+    growing.set_rehash_step(1);
+    for (int i = 0; i < 20'000; i += 2) {
+        growing[i] = 1;
+    }
+    std::list<std::pair<int, int>> linked(pairs.begin(), pairs.end());
+    growing.insert_parallel(linked.begin(), linked.end());
+    CheckAgainst(growing, expected);
+    growing.insert_parallel(pairs.end(), pairs.end());
+    assert(growing.size() == expected.size());
+
+    // A range made almost entirely of duplicates costs one comparison per copy.
+    std::vector<std::pair<int, int>> copies;
+    for (int i = 0; i < 80'000; ++i) {
+        copies.emplace_back(i % 8, i);
+    }
+    UnorderedMap<int, int> few;
+    auto start = std::chrono::steady_clock::now();
+    few.insert_parallel(copies.begin(), copies.end(), 4);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    assert(std::chrono::duration_cast<std::chrono::seconds>(elapsed).count() < 1);
+    std::vector<std::pair<int, int>> firsts;
+    for (int i = 0; i < 8; ++i) {
+        firsts.emplace_back(i, i);
+    }
+    CheckAgainst(few, firsts);
+}
+
+struct ConstantHash {
+    size_t operator()(int) const {
+        return 0;
+    }
+};
+
+void TestRobinHoodLayout() {
+    UnorderedMap<int, int, std::hash<int>, std::equal_to<int>,
+        std::allocator<std::pair<const int, int>>, RobinHoodLayout> m;
+    for (int i = 0; i < 100'000; ++i) {
+        m[i] = i;
+    }
+    auto stats = m.probe_stats();
+    assert(stats.mean >= 1 && stats.variance >= 0 && stats.longest >= stats.mean);
+    for (int i = 0; i < 100'000; i += 2) {
+        m.erase(m.find(i));
+    }
+    assert(m.size() == 50'000);
+    for (int i = 0; i < 200'000; ++i) {
+        assert((m.find(i) == m.end()) == (i % 2 == 0 || i >= 100'000));
+    }
+    long long sum = 0;
+    for (const auto& kv: m) {
+        assert(kv.first == kv.second);
+        sum += kv.second;
+    }
+    assert(sum == 2'500'000'000LL);
+
+    // Erasure shifts elements back, but iteration still sees each one once.
+    size_t visited = 0;
+    for (auto it = m.begin(); it != m.end(); ++visited) {
+        if (it->first % 4 == 1) {
+            it = m.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    assert(visited == 50'000 && m.size() == 25'000);
+    for (int i = 0; i < 100'000; ++i) {
+        assert(m.contains(i) == (i % 4 == 3));
+    }
+    auto middle = m.begin();
+    for (int i = 0; i < 10'000; ++i) {
+        ++middle;
+    }
+    m.erase(middle, m.end());
+    assert(m.size() == 10'000);
+    m.erase(m.begin(), m.end());
+    assert(m.size() == 0 && m.begin() == m.end());
+    assert(m.probe_stats().mean == 0);
+
+    UnorderedMap<NeitherDefaultNorCopyConstructible, NeitherDefaultNorCopyConstructible,
+        std::hash<NeitherDefaultNorCopyConstructible>, std::equal_to<NeitherDefaultNorCopyConstructible>,
+        std::allocator<std::pair<const NeitherDefaultNorCopyConstructible,
+                                 NeitherDefaultNorCopyConstructible>>, RobinHoodLayout> special;
+    for (int i = 0; i < 1'000; ++i) {
+        special.emplace(VerySpecialType(i), VerySpecialType(i));
+    }
+    special.at(VerySpecialType(7)) = VerySpecialType(0);
+    assert(special.at(VerySpecialType(7)).x.x == 0);
+
+    UnorderedMap<Chaste, Chaste, std::hash<Chaste>, std::equal_to<Chaste>,
+        TheChosenOne<std::pair<const Chaste, Chaste>>, RobinHoodLayout> chaste;
+    for (int i = 0; i < 100'000; ++i) {
+        chaste.emplace(i, i);
+    }
+    {
+        auto copy = chaste;
+        copy.reserve(1'000'000);
+        copy.erase(copy.begin());
+        assert(copy.size() == 99'999);
+    }
+    while (chaste.size() > 0) {
+        chaste.erase(chaste.begin());
+    }
+
+    // Growing can't shorten a run of equal hashes, so the table gives up
+    // rather than grow without end, and stays usable.
+    UnorderedMap<int, int, ConstantHash, std::equal_to<int>,
+        std::allocator<std::pair<const int, int>>, RobinHoodLayout> degenerate;
+    bool thrown = false;
+    try {
+        for (int i = 0; i < 10'000; ++i) {
+            degenerate[i] = i;
+        }
+    } catch (const std::length_error&) {
+        thrown = true;
+    }
+    assert(thrown && degenerate.size() == 4'096);
+    assert(degenerate.at(4'095) == 4'095 && !degenerate.contains(4'096));
+
+    // In small tables many runs wrap from the last slot to the first, and an
+    // erasure shifts the element from the first slot into the last one. Erasing
+    // while iterating must still visit every element once, and erasing a range
+    // must remove exactly the elements in it.
+    std::mt19937 random(42);
+    for (int round = 0; round < 20'000; ++round) {
+        UnorderedMap<int, int, std::hash<int>, std::equal_to<int>,
+            std::allocator<std::pair<const int, int>>, RobinHoodLayout> small;
+        for (int i = 0; i < 6; ++i) {
+            small[static_cast<int>(random() % 1'000)] = i;
+        }
+        auto copy = small;
+        std::vector<int> seen;
+        for (auto it = small.begin(); it != small.end();) {
+            seen.push_back(it->first);
+            if (it->second % 2 == 1) {
+                it = small.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        assert(seen.size() == copy.size());
+        std::sort(seen.begin(), seen.end());
+        assert(std::adjacent_find(seen.begin(), seen.end()) == seen.end());
+
+        auto middle = copy.begin();
+        std::advance(middle, round % copy.size());
+        std::vector<int> kept;
+        for (auto it = copy.begin(); it != middle; ++it) {
+            kept.push_back(it->first);
+        }
+        copy.erase(middle, copy.end());
+        assert(copy.size() == kept.size());
+        for (int key: kept) {
+            assert(copy.contains(key));
+        }
+    }
+
+    // A hash that throws while growing leaves the table as it was.
+    UnorderedMap<int, std::string, FlakyHash, std::equal_to<int>,
+        std::allocator<std::pair<const int, std::string>>, RobinHoodLayout> names;
+    for (int i = 0; i < 100; ++i) {
+        names.emplace(i, std::to_string(i));
+    }
+    size_t buckets = names.bucket_count();
+    FlakyHash::calls_left = 50;
+    thrown = false;
+    try {
+        names.reserve(10'000);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    FlakyHash::calls_left = -1;
+    assert(thrown && names.size() == 100 && names.bucket_count() == buckets);
+    for (int i = 0; i < 100; ++i) {
+        assert(names.at(i) == std::to_string(i));
+    }
+}
+
 int main() {
     std::cerr << "Starting tests" << std::endl;
     SimpleTest();
-    std::cerr << "SimpleTest (1 of 6) passed" << std::endl;
+    std::cerr << "SimpleTest (1 of 15) passed" << std::endl;
     TestIterators();
-    std::cerr << "TestIterators (2 of 6) passed" << std::endl;
+    std::cerr << "TestIterators (2 of 15) passed" << std::endl;
     TestConstIteratorDoesntAllowModification(0);
-    std::cerr << "TestConstIteratorDoesntAllowModification (3 of 6) passed" << std::endl;
+    std::cerr << "TestConstIteratorDoesntAllowModification (3 of 15) passed" << std::endl;
     TestNoRedundantCopies();
-    std::cerr << "TestRedundantCopies (4 of 6) passed" << std::endl;
+    std::cerr << "TestRedundantCopies (4 of 15) passed" << std::endl;
     TestCustomHashAndCompare();
-    std::cerr << "TestCustomHashAndCompare (5 of 6) passed" << std::endl;
+    std::cerr << "TestCustomHashAndCompare (5 of 15) passed" << std::endl;
     TestCustomAlloc();
-    std::cerr << "TestCustomAlloc (6 of 6) passed" << std::endl;
+    std::cerr << "TestCustomAlloc (6 of 15) passed" << std::endl;
+    TestSwissLayout();
+    std::cerr << "TestSwissLayout (7 of 15) passed" << std::endl;
+    TestTryEmplaceAndTransparentLookup();
+    std::cerr << "TestTryEmplaceAndTransparentLookup (8 of 15) passed" << std::endl;
+    TestIncrementalRehash();
+    std::cerr << "TestIncrementalRehash (9 of 15) passed" << std::endl;
+    TestRehashPolicies();
+    std::cerr << "TestRehashPolicies (10 of 15) passed" << std::endl;
+    TestGrowthPolicy();
+    std::cerr << "TestGrowthPolicy (11 of 15) passed" << std::endl;
+    TestConcurrentMap();
+    std::cerr << "TestConcurrentMap (12 of 15) passed" << std::endl;
+    TestBatchLookup();
+    std::cerr << "TestBatchLookup (13 of 15) passed" << std::endl;
+    TestParallelBuild();
+    std::cerr << "TestParallelBuild (14 of 15) passed" << std::endl;
+    TestRobinHoodLayout();
+    std::cerr << "TestRobinHoodLayout (15 of 15) passed" << std::endl;
     std::cout << 0;
 }
@@ -0,0 +1,253 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+// Michael-Scott lock-free MPMC queue. Nodes come from a per-queue pool: they are
+// carved out of chunks allocated through allocator_traits (chunk k holds
+// FIRST_CHUNK_SIZE << k nodes) and are recycled through a lock-free free list,
+// never returned to the allocator while the queue is alive. That makes stale
+// reads of a recycled node harmless, and every shared link is a 32-bit node index
+// paired with a 32-bit tag, so ABA is caught by a single 64-bit CAS.
+//
+// Chunk allocation is rare and happens under a mutex, so any allocator works,
+// including a StackAllocator over a plain StackStorage.
+template <typename T, typename Allocator = std::allocator<T> >
+class ConcurrentQueue {
+private:
+    using Tagged = uint64_t;
+
+    static constexpr uint32_t NULL_INDEX = UINT32_MAX;
+    static constexpr size_t FIRST_CHUNK_SIZE = 256;
+    static constexpr size_t MAX_CHUNKS = 24;
+    static constexpr size_t CACHE_LINE = 64;
+
+    static Tagged make_tagged(uint32_t index, uint32_t tag) {
+        return (static_cast<Tagged>(tag) << 32) | index;
+    }
+
+    static uint32_t index_of(Tagged tagged) {
+        return static_cast<uint32_t>(tagged);
+    }
+
+    static uint32_t tag_of(Tagged tagged) {
+        return static_cast<uint32_t>(tagged >> 32);
+    }
+
+    // refs counts the reasons a node can't be recycled yet: it is still linked
+    // into the queue, and its value hasn't been popped. Whoever drops the last
+    // one returns the node to the free list.
+    struct Node {
+        alignas(T) unsigned char storage[sizeof(T)];
+        std::atomic<Tagged> next;
+        std::atomic<int> refs;
+
+        Node() : next(make_tagged(NULL_INDEX, 0)), refs(0) {}
+
+        T* value() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+    using traits_t = std::allocator_traits<NodeAllocator>;
+
+    alignas(CACHE_LINE) std::atomic<Tagged> head_;
+    alignas(CACHE_LINE) std::atomic<Tagged> tail_;
+    alignas(CACHE_LINE) std::atomic<Tagged> free_;
+    std::atomic<uint32_t> next_fresh_;
+    std::atomic<Node*> chunks_[MAX_CHUNKS];
+    std::mutex chunk_mutex_;
+    NodeAllocator node_allocator_;
+
+    static size_t chunk_size(size_t chunk) {
+        return FIRST_CHUNK_SIZE << chunk;
+    }
+
+    static size_t chunk_of(uint32_t index, size_t& offset) {
+        size_t group = index / FIRST_CHUNK_SIZE + 1;
+        size_t chunk = 0;
+        while (group >>= 1) {
+            ++chunk;
+        }
+        offset = index - FIRST_CHUNK_SIZE * ((size_t(1) << chunk) - 1);
+        return chunk;
+    }
+
+    Node* node(uint32_t index) const {
+        size_t offset;
+        size_t chunk = chunk_of(index, offset);
+        return chunks_[chunk].load(std::memory_order_acquire) + offset;
+    }
+
+    Node* allocate_chunk(size_t chunk) {
+        std::lock_guard<std::mutex> lock(chunk_mutex_);
+        Node* nodes = chunks_[chunk].load(std::memory_order_acquire);
+        if (nodes != nullptr) {
+            return nodes;
+        }
+        nodes = traits_t::allocate(node_allocator_, chunk_size(chunk));
+        for (size_t i = 0; i < chunk_size(chunk); ++i) {
+            traits_t::construct(node_allocator_, nodes + i);
+        }
+        chunks_[chunk].store(nodes, std::memory_order_release);
+        return nodes;
+    }
+
+    uint32_t acquire_node() {
+        Tagged head = free_.load();
+        while (index_of(head) != NULL_INDEX) {
+            Tagged next = node(index_of(head))->next.load();
+            if (free_.compare_exchange_weak(head, make_tagged(index_of(next), tag_of(head) + 1))) {
+                return index_of(head);
+            }
+        }
+        uint32_t index = next_fresh_.fetch_add(1);
+        size_t offset;
+        size_t chunk = chunk_of(index, offset);
+        if (chunk >= MAX_CHUNKS) {
+            next_fresh_.fetch_sub(1);
+            throw std::bad_alloc();
+        }
+        if (chunks_[chunk].load(std::memory_order_acquire) == nullptr) {
+            allocate_chunk(chunk);
+        }
+        return index;
+    }
+
+    void release_node(uint32_t index) {
+        Node* released = node(index);
+        Tagged head = free_.load();
+        do {
+            Tagged next = released->next.load();
+            released->next.store(make_tagged(index_of(head), tag_of(next) + 1));
+        } while (!free_.compare_exchange_weak(head, make_tagged(index, tag_of(head) + 1)));
+    }
+
+    void drop_ref(uint32_t index) {
+        if (node(index)->refs.fetch_sub(1) == 1) {
+            release_node(index);
+        }
+    }
+
+    void link(uint32_t index) {
+        Tagged tail;
+        while (true) {
+            tail = tail_.load();
+            Tagged next = node(index_of(tail))->next.load();
+            if (tail != tail_.load()) {
+                continue;
+            }
+            if (index_of(next) == NULL_INDEX) {
+                if (node(index_of(tail))->next.compare_exchange_weak(
+                        next, make_tagged(index, tag_of(next) + 1))) {
+                    break;
+                }
+            } else {
+                tail_.compare_exchange_weak(tail, make_tagged(index_of(next), tag_of(tail) + 1));
+            }
+        }
+        tail_.compare_exchange_strong(tail, make_tagged(index, tag_of(tail) + 1));
+    }
+
+public:
+    explicit ConcurrentQueue(const Allocator& allocator = Allocator())
+        : free_(make_tagged(NULL_INDEX, 0))
+        , next_fresh_(0)
+        , node_allocator_(allocator)
+    {
+        for (auto& chunk: chunks_) {
+            chunk.store(nullptr);
+        }
+        uint32_t dummy = acquire_node();
+        node(dummy)->refs.store(1);
+        head_.store(make_tagged(dummy, 0));
+        tail_.store(make_tagged(dummy, 0));
+    }
+
+    ConcurrentQueue(const ConcurrentQueue&) = delete;
+
+    ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
+
+    // Must not race with any other operation.
+    ~ConcurrentQueue() {
+        uint32_t current = index_of(node(index_of(head_.load()))->next.load());
+        while (current != NULL_INDEX) {
+            Node* item = node(current);
+            item->value()->~T();
+            current = index_of(item->next.load());
+        }
+        for (size_t chunk = 0; chunk < MAX_CHUNKS; ++chunk) {
+            Node* nodes = chunks_[chunk].load();
+            if (nodes == nullptr) {
+                continue;
+            }
+            for (size_t i = 0; i < chunk_size(chunk); ++i) {
+                traits_t::destroy(node_allocator_, nodes + i);
+            }
+            traits_t::deallocate(node_allocator_, nodes, chunk_size(chunk));
+        }
+    }
+
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        uint32_t index = acquire_node();
+        Node* inserted = node(index);
+        try {
+            new(inserted->storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            release_node(index);
+            throw;
+        }
+        inserted->refs.store(2);
+        Tagged next = inserted->next.load();
+        inserted->next.store(make_tagged(NULL_INDEX, tag_of(next) + 1));
+        link(index);
+    }
+
+    void push(const T& item) {
+        emplace(item);
+    }
+
+    void push(T&& item) {
+        emplace(std::move(item));
+    }
+
+    // Moves the front element into item. Returns false if the queue was empty.
+    bool try_pop(T& item) {
+        Tagged head;
+        Tagged next;
+        while (true) {
+            head = head_.load();
+            Tagged tail = tail_.load();
+            next = node(index_of(head))->next.load();
+            if (head != head_.load()) {
+                continue;
+            }
+            if (index_of(head) == index_of(tail)) {
+                if (index_of(next) == NULL_INDEX) {
+                    return false;
+                }
+                tail_.compare_exchange_weak(tail, make_tagged(index_of(next), tag_of(tail) + 1));
+            } else if (head_.compare_exchange_weak(head, make_tagged(index_of(next), tag_of(head) + 1))) {
+                break;
+            }
+        }
+        drop_ref(index_of(head));
+        Node* popped = node(index_of(next));
+        item = std::move(*popped->value());
+        popped->value()->~T();
+        drop_ref(index_of(next));
+        return true;
+    }
+
+    // Only a hint while other threads are pushing or popping.
+    bool empty() const {
+        Tagged head = head_.load();
+        return index_of(node(index_of(head))->next.load()) == NULL_INDEX;
+    }
+};
@@ -0,0 +1,534 @@
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Double-ended queue over fixed-size blocks of about BLOCK_BYTES each, reached
+// through a map of block pointers. Elements are never allocated one by one, so a
+// bump allocator like StackAllocator sees one allocation per block. Blocks left
+// empty by pops stay in the map and are reused: when one end of the map runs out,
+// the map is rotated in place if it is at most half full, so a queue that keeps
+// a steady size stops allocating once it has warmed up. shrink_to_fit() returns
+// the spare blocks.
+//
+// As with std::deque, pushes may invalidate iterators, but never references.
+template <typename T, typename Allocator = std::allocator<T> >
+class Deque {
+private:
+    using BlockAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+    using traits_t = std::allocator_traits<BlockAllocator>;
+
+    using MapAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T*>;
+
+    using map_traits_t = std::allocator_traits<MapAllocator>;
+
+    static constexpr size_t BLOCK_BYTES = 4096;
+    static constexpr size_t MIN_MAP_SIZE = 8;
+
+    // A power of two, so that positions split into block and offset with a
+    // shift and a mask.
+    static constexpr size_t block_size() {
+        size_t result = 16;
+        while (result * 2 * sizeof(T) <= BLOCK_BYTES) {
+            result *= 2;
+        }
+        return result;
+    }
+
+    static constexpr size_t BLOCK_SIZE = block_size();
+
+    // Element i lives at position start_ + i, that is in block
+    // map_[(start_ + i) / BLOCK_SIZE]. Map slots outside the live range hold
+    // either nullptr or a spare block.
+    T** map_ = nullptr;
+    size_t map_size_ = 0;
+    size_t start_ = 0;
+    size_t size_ = 0;
+    BlockAllocator allocator_;
+
+    static size_t blocks_for(size_t count) {
+        return (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    T* slot(size_t position) const {
+        return map_[position / BLOCK_SIZE] + position % BLOCK_SIZE;
+    }
+
+    void take_contents(Deque& other) noexcept {
+        map_ = std::exchange(other.map_, nullptr);
+        map_size_ = std::exchange(other.map_size_, 0);
+        start_ = std::exchange(other.start_, 0);
+        size_ = std::exchange(other.size_, 0);
+    }
+
+    void swap_contents(Deque& other) noexcept {
+        std::swap(map_, other.map_);
+        std::swap(map_size_, other.map_size_);
+        std::swap(start_, other.start_);
+        std::swap(size_, other.size_);
+        std::swap(allocator_, other.allocator_);
+    }
+
+    void release_map() {
+        MapAllocator map_allocator(allocator_);
+        for (size_t i = 0; i < map_size_; ++i) {
+            if (map_[i] != nullptr) {
+                traits_t::deallocate(allocator_, map_[i], BLOCK_SIZE);
+            }
+        }
+        if (map_ != nullptr) {
+            map_traits_t::deallocate(map_allocator, map_, map_size_);
+        }
+        map_ = nullptr;
+        map_size_ = 0;
+    }
+
+    // Makes room in the map for `front` more elements before the first one and
+    // `back` more after the last one. The live blocks move as a whole, spare
+    // blocks travel along with them, so no block is ever lost or reallocated.
+    void arrange_map(size_t front, size_t back) {
+        size_t offset = start_ % BLOCK_SIZE;
+        size_t first_block = start_ / BLOCK_SIZE;
+        size_t front_blocks = front > offset ? blocks_for(front - offset) : 0;
+        size_t back_blocks = blocks_for(offset + size_ + back);
+        if (first_block >= front_blocks && first_block + back_blocks <= map_size_) {
+            return;
+        }
+        size_t needed = front_blocks + back_blocks;
+        size_t new_map_size = map_size_;
+        if (2 * needed > map_size_) {
+            new_map_size = std::max({2 * map_size_, 2 * needed, MIN_MAP_SIZE});
+        }
+        size_t new_first_block = front_blocks + (new_map_size - needed) / 2;
+        if (new_map_size == map_size_) {
+            size_t shift = (first_block + map_size_ - new_first_block) % map_size_;
+            std::rotate(map_, map_ + shift, map_ + map_size_);
+        } else {
+            MapAllocator map_allocator(allocator_);
+            T** new_map = map_traits_t::allocate(map_allocator, new_map_size);
+            std::fill(new_map, new_map + new_map_size, nullptr);
+            for (size_t i = 0; i < map_size_; ++i) {
+                new_map[(new_first_block + i) % new_map_size] = map_[(first_block + i) % map_size_];
+            }
+            if (map_ != nullptr) {
+                map_traits_t::deallocate(map_allocator, map_, map_size_);
+            }
+            map_ = new_map;
+            map_size_ = new_map_size;
+        }
+        start_ = new_first_block * BLOCK_SIZE + offset;
+    }
+
+    // Allocates the missing blocks for positions [first, last).
+    void allocate_blocks(size_t first, size_t last) {
+        for (size_t block = first / BLOCK_SIZE; block < blocks_for(last); ++block) {
+            if (map_[block] == nullptr) {
+                map_[block] = traits_t::allocate(allocator_, BLOCK_SIZE);
+            }
+        }
+    }
+
+public:
+    Deque() : allocator_() {}
+
+    Deque(Allocator allocator) : allocator_(allocator) {}
+
+    Deque(size_t count, Allocator allocator = Allocator()) : Deque(allocator) {
+        reserve_back(count);
+        for (size_t i = 0; i < count; ++i) {
+            emplace_back();
+        }
+    }
+
+    Deque(size_t count, const T& item, Allocator allocator = Allocator()) : Deque(allocator) {
+        reserve_back(count);
+        for (size_t i = 0; i < count; ++i) {
+            emplace_back(item);
+        }
+    }
+
+    template <typename InputIter, typename = std::enable_if_t<std::is_base_of_v<
+        std::input_iterator_tag, typename std::iterator_traits<InputIter>::iterator_category> > >
+    Deque(InputIter first, InputIter last, Allocator allocator = Allocator()) : Deque(allocator) {
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                      typename std::iterator_traits<InputIter>::iterator_category>) {
+            reserve_back(std::distance(first, last));
+        }
+        for (; first != last; ++first) {
+            emplace_back(*first);
+        }
+    }
+
+    Deque(const Deque& other)
+        : allocator_(traits_t::select_on_container_copy_construction(other.allocator_)) {
+        reserve_back(other.size_);
+        for (const T& item: other) {
+            emplace_back(item);
+        }
+    }
+
+    Deque(Deque&& other) noexcept : allocator_(other.allocator_) {
+        take_contents(other);
+    }
+
+    Deque& operator=(const Deque& other) {
+        if (this == &other) {
+            return *this;
+        }
+        BlockAllocator allocator = allocator_;
+        if constexpr (traits_t::propagate_on_container_copy_assignment::value) {
+            allocator = other.allocator_;
+        }
+        Deque copy(allocator);
+        copy.reserve_back(other.size_);
+        for (const T& item: other) {
+            copy.emplace_back(item);
+        }
+        swap_contents(copy);
+        return *this;
+    }
+
+    Deque& operator=(Deque&& other) noexcept(
+            traits_t::propagate_on_container_move_assignment::value
+            || traits_t::is_always_equal::value) {
+        if (this == &other) {
+            return *this;
+        }
+        if constexpr (traits_t::propagate_on_container_move_assignment::value) {
+            clear();
+            release_map();
+            allocator_ = other.allocator_;
+            take_contents(other);
+        } else {
+            if (traits_t::is_always_equal::value || allocator_ == other.allocator_) {
+                clear();
+                release_map();
+                take_contents(other);
+            } else {
+                clear();
+                reserve_back(other.size_);
+                for (T& item: other) {
+                    emplace_back(std::move(item));
+                }
+                other.clear();
+            }
+        }
+        return *this;
+    }
+
+    ~Deque() {
+        clear();
+        release_map();
+    }
+
+    Allocator get_allocator() const {
+        return Allocator(allocator_);
+    }
+
+    size_t size() const noexcept {
+        return size_;
+    }
+
+    bool empty() const noexcept {
+        return size_ == 0;
+    }
+
+    T& operator[](size_t index) {
+        return *slot(start_ + index);
+    }
+
+    const T& operator[](size_t index) const {
+        return *slot(start_ + index);
+    }
+
+    T& at(size_t index) {
+        if (index >= size_) {
+            throw std::out_of_range("Deque::at");
+        }
+        return (*this)[index];
+    }
+
+    const T& at(size_t index) const {
+        if (index >= size_) {
+            throw std::out_of_range("Deque::at");
+        }
+        return (*this)[index];
+    }
+
+    T& front() {
+        return *slot(start_);
+    }
+
+    const T& front() const {
+        return *slot(start_);
+    }
+
+    T& back() {
+        return *slot(start_ + size_ - 1);
+    }
+
+    const T& back() const {
+        return *slot(start_ + size_ - 1);
+    }
+
+    // After reserve_back(n), the next n pushes to the back allocate nothing.
+    void reserve_back(size_t count) {
+        arrange_map(0, count);
+        allocate_blocks(start_ + size_, start_ + size_ + count);
+    }
+
+    // After reserve_front(n), the next n pushes to the front allocate nothing.
+    void reserve_front(size_t count) {
+        arrange_map(count, 0);
+        allocate_blocks(start_ - count, start_);
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        size_t position = start_ + size_;
+        if (position == map_size_ * BLOCK_SIZE || map_[position / BLOCK_SIZE] == nullptr) {
+            reserve_back(1);
+            position = start_ + size_;
+        }
+        T* inserted = slot(position);
+        traits_t::construct(allocator_, inserted, std::forward<Args>(args)...);
+        ++size_;
+        return *inserted;
+    }
+
+    template <typename... Args>
+    T& emplace_front(Args&&... args) {
+        if (start_ == 0 || map_[(start_ - 1) / BLOCK_SIZE] == nullptr) {
+            reserve_front(1);
+        }
+        T* inserted = slot(start_ - 1);
+        traits_t::construct(allocator_, inserted, std::forward<Args>(args)...);
+        --start_;
+        ++size_;
+        return *inserted;
+    }
+
+    void push_back(const T& item) {
+        emplace_back(item);
+    }
+
+    void push_back(T&& item) {
+        emplace_back(std::move(item));
+    }
+
+    void push_front(const T& item) {
+        emplace_front(item);
+    }
+
+    void push_front(T&& item) {
+        emplace_front(std::move(item));
+    }
+
+    void pop_back() {
+        traits_t::destroy(allocator_, slot(start_ + size_ - 1));
+        --size_;
+    }
+
+    void pop_front() {
+        traits_t::destroy(allocator_, slot(start_));
+        ++start_;
+        --size_;
+    }
+
+    // Destroys the elements but keeps every block for reuse.
+    void clear() {
+        while (size_ > 0) {
+            pop_back();
+        }
+    }
+
+    // Returns the blocks that hold no element to the allocator.
+    void shrink_to_fit() {
+        if (size_ == 0) {
+            release_map();
+            start_ = 0;
+            return;
+        }
+        size_t first_block = start_ / BLOCK_SIZE;
+        size_t last_block = blocks_for(start_ + size_);
+        for (size_t i = 0; i < map_size_; ++i) {
+            if ((i < first_block || i >= last_block) && map_[i] != nullptr) {
+                traits_t::deallocate(allocator_, map_[i], BLOCK_SIZE);
+                map_[i] = nullptr;
+            }
+        }
+    }
+
+    template <bool IsConst>
+    class CommonIterator {
+    private:
+        T* const* map_;
+        size_t position_;
+
+    public:
+        using value_type = std::conditional_t<IsConst, const T, T>;
+        using pointer = std::conditional_t<IsConst, const T*, T*>;
+        using reference = std::conditional_t<IsConst, const T&, T&>;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::random_access_iterator_tag;
+
+        CommonIterator(T* const* map, size_t position) : map_(map), position_(position) {}
+
+        CommonIterator(const CommonIterator<false>& other)
+            : map_(other.map_), position_(other.position_) {}
+
+        CommonIterator& operator=(const CommonIterator<false>& other) {
+            map_ = other.map_;
+            position_ = other.position_;
+            return *this;
+        }
+
+        ~CommonIterator() = default;
+
+        CommonIterator& operator++() {
+            ++position_;
+            return *this;
+        }
+
+        CommonIterator operator++(int) {
+            CommonIterator result = *this;
+            ++position_;
+            return result;
+        }
+
+        CommonIterator& operator--() {
+            --position_;
+            return *this;
+        }
+
+        CommonIterator operator--(int) {
+            CommonIterator result = *this;
+            --position_;
+            return result;
+        }
+
+        CommonIterator& operator+=(difference_type shift) {
+            position_ += shift;
+            return *this;
+        }
+
+        CommonIterator& operator-=(difference_type shift) {
+            position_ -= shift;
+            return *this;
+        }
+
+        CommonIterator operator+(difference_type shift) const {
+            CommonIterator result = *this;
+            return result += shift;
+        }
+
+        CommonIterator operator-(difference_type shift) const {
+            CommonIterator result = *this;
+            return result -= shift;
+        }
+
+        friend CommonIterator operator+(difference_type shift, const CommonIterator& iter) {
+            return iter + shift;
+        }
+
+        template <bool IsConstOther>
+        difference_type operator-(const CommonIterator<IsConstOther>& other) const {
+            return static_cast<difference_type>(position_ - other.position_);
+        }
+
+        reference operator*() const {
+            return map_[position_ / BLOCK_SIZE][position_ % BLOCK_SIZE];
+        }
+
+        pointer operator->() const {
+            return &**this;
+        }
+
+        reference operator[](difference_type index) const {
+            return *(*this + index);
+        }
+
+        template <bool IsConstOther>
+        bool operator==(const CommonIterator<IsConstOther>& other) const {
+            return position_ == other.position_;
+        }
+
+        template <bool IsConstOther>
+        bool operator!=(const CommonIterator<IsConstOther>& other) const {
+            return !(*this == other);
+        }
+
+        template <bool IsConstOther>
+        bool operator<(const CommonIterator<IsConstOther>& other) const {
+            return position_ < other.position_;
+        }
+
+        template <bool IsConstOther>
+        bool operator>(const CommonIterator<IsConstOther>& other) const {
+            return other < *this;
+        }
+
+        template <bool IsConstOther>
+        bool operator<=(const CommonIterator<IsConstOther>& other) const {
+            return !(other < *this);
+        }
+
+        template <bool IsConstOther>
+        bool operator>=(const CommonIterator<IsConstOther>& other) const {
+            return !(*this < other);
+        }
+
+        template <bool IsConstOther>
+        friend class CommonIterator;
+    };
+
+    using iterator = CommonIterator<false>;
+    using const_iterator = CommonIterator<true>;
+
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    iterator begin() noexcept {
+        return iterator(map_, start_);
+    }
+
+    iterator end() noexcept {
+        return iterator(map_, start_ + size_);
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(map_, start_);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(map_, start_ + size_);
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    reverse_iterator rbegin() noexcept {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() noexcept {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const noexcept {
+        return const_reverse_iterator(cend());
+    }
+
+    const_reverse_iterator crend() const noexcept {
+        return const_reverse_iterator(cbegin());
+    }
+};
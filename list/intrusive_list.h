@@ -0,0 +1,309 @@
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+struct IntrusiveBaseNode {
+    IntrusiveBaseNode* prev = nullptr;
+    IntrusiveBaseNode* next = nullptr;
+};
+
+// Embed into T (struct T: IntrusiveListHook<> {...}) to thread T onto an IntrusiveList
+// without any allocation. Use different tags to put one object onto several lists.
+// With SafeUnlink, unlinked hooks are reset to null, so linking an object twice or
+// destroying it while it is still on a list is caught by an assert.
+template <typename Tag = void, bool SafeUnlink = false>
+class IntrusiveListHook: private IntrusiveBaseNode {
+public:
+    static constexpr bool SAFE_UNLINK = SafeUnlink;
+
+    IntrusiveListHook() = default;
+
+    // Copying an object must not copy its position in a list.
+    IntrusiveListHook(const IntrusiveListHook&) : IntrusiveBaseNode() {}
+
+    IntrusiveListHook& operator=(const IntrusiveListHook&) {
+        return *this;
+    }
+
+    ~IntrusiveListHook() {
+        if constexpr (SafeUnlink) {
+            assert(!is_linked() && "object destroyed while still in an IntrusiveList");
+        }
+    }
+
+    // Only reliable in SafeUnlink mode: otherwise a hook keeps its stale links
+    // after being erased.
+    bool is_linked() const {
+        return next != nullptr;
+    }
+
+    template <typename T, typename Hook>
+    friend class IntrusiveList;
+};
+
+template <typename T, typename Hook = IntrusiveListHook<> >
+class IntrusiveList {
+private:
+    using BaseNode = IntrusiveBaseNode;
+
+    static_assert(std::is_base_of_v<Hook, T>, "T must derive from the list hook");
+
+    BaseNode fake_object_;
+    BaseNode* fake_ = &fake_object_;
+    size_t size_;
+
+    void create_fake_node() {
+        fake_->prev = fake_->next = fake_;
+    }
+
+    static BaseNode* to_node(T& item) {
+        return static_cast<BaseNode*>(static_cast<Hook*>(&item));
+    }
+
+    static T& to_item(BaseNode* node) {
+        return static_cast<T&>(*static_cast<Hook*>(node));
+    }
+
+    static void link_before(BaseNode* after, BaseNode* inserted) {
+        if constexpr (Hook::SAFE_UNLINK) {
+            assert(inserted->next == nullptr && "object is already in an IntrusiveList");
+        }
+        after->prev->next = inserted;
+        inserted->prev = after->prev;
+        inserted->next = after;
+        after->prev = inserted;
+    }
+
+    static void unlink(BaseNode* node) {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        if constexpr (Hook::SAFE_UNLINK) {
+            node->prev = node->next = nullptr;
+        }
+    }
+
+public:
+    IntrusiveList() : size_(0) {
+        create_fake_node();
+    }
+
+    IntrusiveList(const IntrusiveList&) = delete;
+
+    IntrusiveList(IntrusiveList&& other) noexcept : size_(0) {
+        create_fake_node();
+        *this = std::move(other);
+    }
+
+    IntrusiveList& operator=(const IntrusiveList&) = delete;
+
+    IntrusiveList& operator=(IntrusiveList&& other) noexcept {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        if (other.size_ > 0) {
+            fake_->next = other.fake_->next;
+            fake_->prev = other.fake_->prev;
+            fake_->next->prev = fake_;
+            fake_->prev->next = fake_;
+            other.create_fake_node();
+        }
+        size_ = std::exchange(other.size_, 0);
+        return *this;
+    }
+
+    // The list never owns its elements: clearing it only unlinks them.
+    ~IntrusiveList() {
+        clear();
+    }
+
+    void clear() {
+        if constexpr (Hook::SAFE_UNLINK) {
+            while (size_ > 0) {
+                pop_back();
+            }
+        }
+        create_fake_node();
+        size_ = 0;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    T& front() const {
+        return to_item(fake_->next);
+    }
+
+    T& back() const {
+        return to_item(fake_->prev);
+    }
+
+    void push_back(T& item) {
+        link_before(fake_, to_node(item));
+        ++size_;
+    }
+
+    void push_front(T& item) {
+        link_before(fake_->next, to_node(item));
+        ++size_;
+    }
+
+    void pop_back() {
+        unlink(fake_->prev);
+        --size_;
+    }
+
+    void pop_front() {
+        unlink(fake_->next);
+        --size_;
+    }
+
+    template <bool IsConst>
+    class CommonIterator {
+    private:
+        BaseNode* position_;
+
+    public:
+        using value_type = std::conditional_t<IsConst, const T, T>;
+        using pointer = std::conditional_t<IsConst, const T*, T*>;
+        using reference = std::conditional_t<IsConst, const T&, T&>;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::bidirectional_iterator_tag;
+
+        CommonIterator(BaseNode* position) : position_(position) {}
+
+        CommonIterator(const CommonIterator<false>& other)
+            : position_(other.position_) {}
+
+        CommonIterator& operator=(const CommonIterator<false>& other) {
+            position_ = other.position_;
+            return *this;
+        }
+
+        ~CommonIterator() = default;
+
+        CommonIterator& operator++() {
+            position_ = position_->next;
+            return *this;
+        }
+
+        CommonIterator operator++(int) {
+            CommonIterator result = *this;
+            position_ = position_->next;
+            return result;
+        }
+
+        CommonIterator& operator--() {
+            position_ = position_->prev;
+            return *this;
+        }
+
+        CommonIterator operator--(int) {
+            CommonIterator result = *this;
+            position_ = position_->prev;
+            return result;
+        }
+
+        reference operator*() const {
+            return to_item(position_);
+        }
+
+        pointer operator->() const {
+            return &to_item(position_);
+        }
+
+        template <bool IsConstOther>
+        bool operator==(CommonIterator<IsConstOther> other) const {
+            return position_ == other.position_;
+        }
+
+        template <bool IsConstOther>
+        bool operator!=(CommonIterator<IsConstOther> other) const {
+            return !(*this == other);
+        }
+
+        template <bool IsConstOther>
+        friend class CommonIterator;
+
+        friend class IntrusiveList;
+    };
+
+    using iterator = CommonIterator<false>;
+    using const_iterator = CommonIterator<true>;
+
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    iterator begin() const noexcept {
+        return iterator(fake_->next);
+    }
+
+    iterator end() const noexcept {
+        return iterator(fake_);
+    }
+
+    const_iterator cbegin() const noexcept {
+        return const_iterator(fake_->next);
+    }
+
+    const_iterator cend() const noexcept {
+        return const_iterator(fake_);
+    }
+
+    reverse_iterator rbegin() const noexcept {
+        return reverse_iterator(iterator(fake_));
+    }
+
+    reverse_iterator rend() const noexcept {
+        return reverse_iterator(iterator(fake_->next));
+    }
+
+    const_reverse_iterator crbegin() const noexcept {
+        return const_reverse_iterator(const_iterator(fake_));
+    }
+
+    const_reverse_iterator crend() const noexcept {
+        return const_reverse_iterator(const_iterator(fake_->next));
+    }
+
+    // O(1): the hook already knows where the item is.
+    iterator iterator_to(T& item) const noexcept {
+        return iterator(to_node(item));
+    }
+
+    iterator insert(const_iterator iter, T& item) {
+        BaseNode* inserted = to_node(item);
+        link_before(iter.position_, inserted);
+        ++size_;
+        return iterator(inserted);
+    }
+
+    iterator erase(const_iterator iter) {
+        BaseNode* after = iter.position_->next;
+        unlink(iter.position_);
+        --size_;
+        return iterator(after);
+    }
+
+    iterator erase(T& item) {
+        return erase(iterator_to(item));
+    }
+
+    void splice(const_iterator pos, IntrusiveList& other, const_iterator it) {
+        BaseNode* node = it.position_;
+        if (node == pos.position_) {
+            return;
+        }
+        unlink(node);
+        link_before(pos.position_, node);
+        --other.size_;
+        ++size_;
+    }
+};
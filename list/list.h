@@ -1,6 +1,14 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <cstddef>
+#include <functional>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 template <size_t N>
 class alignas(std::max_align_t) StackStorage {
@@ -21,10 +29,118 @@ public:
     }
 };
 
-template <typename T, size_t N>
+// StackStorage that may be shared between threads: every allocation is a single
+// fetch_add on position_. Sizes are rounded up to ALIGNMENT so that position_
+// stays aligned for every fundamental type without a CAS loop.
+template <size_t N>
+class alignas(std::max_align_t) AtomicStackStorage {
+private:
+    static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+
+    char memory_[N];
+    std::atomic<size_t> position_;
+    
+public:
+    AtomicStackStorage() : position_(0) {}
+    
+    AtomicStackStorage(const AtomicStackStorage&) = delete;
+    
+    AtomicStackStorage& operator=(const AtomicStackStorage&) = delete;
+    
+    // Throws std::bad_alloc if the request runs past the end. The failed
+    // request still advances position_, so the arena counts as full from then on.
+    char* get_memory(size_t count, size_t align) {
+        size_t size = (count + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        if (align > ALIGNMENT) {
+            size += align;
+        }
+        size_t start = position_.fetch_add(size, std::memory_order_relaxed);
+        if (start > N || N - start < size) {
+            throw std::bad_alloc();
+        }
+        if (align <= ALIGNMENT) {
+            return memory_ + start;
+        }
+        return memory_ + (start + align - 1) / align * align;
+    }
+};
+
+inline size_t current_thread_index() {
+    static std::atomic<size_t> next_index(0);
+    thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+// StackStorage shared between threads where each thread bumps a pointer inside
+// its own chunk and only touches the shared atomic position_ to grab the next
+// chunk. The chunks are kept in the storage, one slot per thread index, so a thread
+// that switches between storages never gives up the rest of a chunk. Thread indices
+// are not reused; threads past THREAD_SLOTS allocate straight from position_.
+template <size_t N, size_t ChunkSize = 64 * 1024>
+class alignas(std::max_align_t) ThreadLocalStackStorage {
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr size_t THREAD_SLOTS = 64;
+
+    struct alignas(CACHE_LINE) LocalChunk {
+        char* position = nullptr;
+        char* end = nullptr;
+    };
+
+    char memory_[N];
+    std::atomic<size_t> position_;
+    LocalChunk chunks_[THREAD_SLOTS];
+
+    // Claims up to wanted bytes of the arena, settling for a shorter tail near the
+    // end as long as at least minimum bytes are left. Sets end past the claimed range.
+    char* reserve(size_t wanted, size_t minimum, char*& end) {
+        size_t position = position_.load(std::memory_order_relaxed);
+        size_t size = 0;
+        do {
+            if (N - position < minimum) {
+                throw std::bad_alloc();
+            }
+            size = std::min(wanted, N - position);
+        } while (!position_.compare_exchange_weak(position, position + size, std::memory_order_relaxed));
+        end = memory_ + position + size;
+        return memory_ + position;
+    }
+
+    static char* align_up(char* ptr, size_t align) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+        return ptr + ((address + align - 1) / align * align - address);
+    }
+
+public:
+    ThreadLocalStackStorage() : position_(0) {}
+    
+    ThreadLocalStackStorage(const ThreadLocalStackStorage&) = delete;
+    
+    ThreadLocalStackStorage& operator=(const ThreadLocalStackStorage&) = delete;
+    
+    char* get_memory(size_t count, size_t align) {
+        size_t index = current_thread_index();
+        char* end = nullptr;
+        if (index >= THREAD_SLOTS || count + align > ChunkSize / 4) {
+            return align_up(reserve(count + align, count + align, end), align);
+        }
+        LocalChunk& chunk = chunks_[index];
+        char* start = chunk.position == nullptr ? nullptr : align_up(chunk.position, align);
+        if (start == nullptr || start + count > chunk.end) {
+            chunk.position = reserve(ChunkSize, count + align, chunk.end);
+            start = align_up(chunk.position, align);
+        }
+        chunk.position = start + count;
+        return start;
+    }
+};
+
+// Storage is anything with get_memory(count, align): StackStorage<N> by default,
+// or AtomicStackStorage<N>/ThreadLocalStackStorage<N> to share one arena between threads.
+template <typename T, size_t N, typename Storage = StackStorage<N> >
 class StackAllocator {
 private:
-    StackStorage<N>* storage_;
+    Storage* storage_;
 
 public:
     using value_type = T;
@@ -37,47 +153,42 @@ public:
     
     template <typename U>
     struct rebind {
-        using other = StackAllocator<U, N>;
+        using other = StackAllocator<U, N, Storage>;
     };
     
     StackAllocator() = delete;
     
-    StackAllocator(StackStorage<N>& init_storage) : storage_(&init_storage) {}
+    StackAllocator(Storage& init_storage) : storage_(&init_storage) {}
     
     template <typename U>
-    StackAllocator(const StackAllocator<U, N>& other) noexcept : storage_(other.storage_) {}
+    StackAllocator(const StackAllocator<U, N, Storage>& other) noexcept : storage_(other.storage_) {}
     
     StackAllocator& operator=(const StackAllocator& other) {
         storage_ = other.storage_;
         return *this;
     }
     
-    T* allocate(size_t count) noexcept {
+    T* allocate(size_t count) {
         return reinterpret_cast<T*>(storage_->get_memory(sizeof(T) * count, alignof(T)));
     }
     
     void deallocate(T*, size_t) noexcept {}
     
-    template <typename... Args>
-    void construct(T* ptr, const Args&... args) {
-        new(ptr) T(args...);
-    }
-    
     StackAllocator select_on_container_copy_construction() const {
         return *this;
     }
     
-    template <typename U, size_t M>
-    bool operator==(const StackAllocator<U, M>& other) const {
+    template <typename U, size_t M, typename OtherStorage>
+    bool operator==(const StackAllocator<U, M, OtherStorage>& other) const {
         return true;
     }
     
-    template <typename U, size_t M>
-    bool operator!=(const StackAllocator<U, M>& other) const {
+    template <typename U, size_t M, typename OtherStorage>
+    bool operator!=(const StackAllocator<U, M, OtherStorage>& other) const {
         return false;
     }
     
-    template <typename U, size_t M>
+    template <typename U, size_t M, typename OtherStorage>
     friend class StackAllocator;
 };
 
@@ -89,61 +200,205 @@ private:
         BaseNode* next;
     };
     
+    struct NodeBlock;
+    
     struct Node: BaseNode {
         T value;
-        
-        Node() {}
+        // Block the node was carved out of, nullptr for a standalone node.
+        NodeBlock* block = nullptr;
         
         template <typename... Args>
-        Node(const Args&... args) : value(args...) {}
+        Node(Args&&... args) : value(std::forward<Args>(args)...) {}
     };
     
     using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
     
     using traits_t = std::allocator_traits<NodeAllocator>;
     
-    BaseNode* fake_;
+    // Nodes created by a range insert share one allocation. Every node points
+    // back at its block, which is returned to the allocator once the last of
+    // its nodes is erased. next only links the blocks of a chain under construction.
+    struct NodeBlock {
+        NodeBlock* next;
+        Node* nodes;
+        size_t capacity;
+        size_t alive;
+    };
+    
+    using BlockAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<NodeBlock>;
+    
+    using block_traits_t = std::allocator_traits<BlockAllocator>;
+    
+    static constexpr size_t MIN_BATCH_SIZE = 16;
+    static constexpr size_t MAX_BATCH_SIZE = 1 << 16;
+    
+    template <typename Iter>
+    using iterator_category_t = typename std::iterator_traits<Iter>::iterator_category;
+    
+    template <typename Iter, typename = void>
+    struct is_input_iterator : std::false_type {};
+    
+    template <typename Iter>
+    struct is_input_iterator<Iter, std::void_t<iterator_category_t<Iter> > >
+        : std::is_base_of<std::input_iterator_tag, iterator_category_t<Iter> > {};
+    
+    template <typename Iter>
+    using enable_if_input_iterator_t = std::enable_if_t<is_input_iterator<Iter>::value>;
+    
+    BaseNode fake_object_;
+    BaseNode* fake_ = &fake_object_;
     size_t size_;
     NodeAllocator node_allocator_;
     
     void create_fake_node() {
-        fake_ = traits_t::allocate(node_allocator_, 1);
-        new(fake_) BaseNode();
         fake_->prev = fake_->next = fake_;
     }
     
-    template <typename... Args>
-    void emplace(const Args&... args) {
-        BaseNode* end = fake_->prev;
-        end->next = traits_t::allocate(node_allocator_, 1);
+    // Takes over the nodes of other, which must use an allocator
+    // equal to ours. This list must be empty, other is left empty.
+    void take_nodes(List& other) noexcept {
+        if (other.size_ == 0) {
+            create_fake_node();
+        } else {
+            fake_->next = other.fake_->next;
+            fake_->prev = other.fake_->prev;
+            fake_->next->prev = fake_;
+            fake_->prev->next = fake_;
+            other.create_fake_node();
+        }
+        size_ = std::exchange(other.size_, 0);
+    }
+    
+    void swap_contents(List& other) noexcept {
+        List tmp(other.node_allocator_, 0);
+        tmp.take_nodes(other);
+        other.take_nodes(*this);
+        take_nodes(tmp);
+        std::swap(node_allocator_, other.node_allocator_);
+    }
+    
+    // Builds an empty list straight from a node allocator, so copies and moves
+    // don't have to convert it back to Allocator. The int only disambiguates.
+    List(const NodeAllocator& allocator, int) noexcept
+        : size_(0), node_allocator_(allocator) {
+        create_fake_node();
+    }
+    
+    NodeBlock* allocate_block(size_t capacity) {
+        BlockAllocator block_allocator(node_allocator_);
+        NodeBlock* block = block_traits_t::allocate(block_allocator, 1);
         try {
-            traits_t::construct(node_allocator_, static_cast<Node*>(end->next), args...);
+            block->nodes = traits_t::allocate(node_allocator_, capacity);
         } catch (...) {
-            traits_t::deallocate(node_allocator_, static_cast<Node*>(end->next), 1);
-            end->next = fake_;
+            block_traits_t::deallocate(block_allocator, block, 1);
             throw;
         }
-        end->next->prev = end;
-        end->next->next = fake_;
-        fake_->prev = end->next;
+        block->next = nullptr;
+        block->capacity = capacity;
+        block->alive = 0;
+        return block;
+    }
+    
+    void deallocate_block(NodeBlock* block) {
+        BlockAllocator block_allocator(node_allocator_);
+        traits_t::deallocate(node_allocator_, block->nodes, block->capacity);
+        block_traits_t::deallocate(block_allocator, block, 1);
+    }
+    
+    // Destroys the element and frees its memory: a standalone node goes straight
+    // back to the allocator, a block node releases its block with the last one.
+    void destroy_node(BaseNode* node) {
+        Node* ptr = static_cast<Node*>(node);
+        NodeBlock* block = ptr->block;
+        traits_t::destroy(node_allocator_, ptr);
+        if (block == nullptr) {
+            traits_t::deallocate(node_allocator_, ptr, 1);
+        } else if (--block->alive == 0) {
+            deallocate_block(block);
+        }
     }
     
-public:
-    List() : size_(0) {
-        create_fake_node();
+    // Destroys every node of a detached chain and frees the blocks it was built in.
+    void release_chain(BaseNode* chain, NodeBlock* blocks) {
+        for (BaseNode* current = chain->next; current != chain;) {
+            BaseNode* next = current->next;
+            traits_t::destroy(node_allocator_, static_cast<Node*>(current));
+            current = next;
+        }
+        while (blocks != nullptr) {
+            NodeBlock* next = blocks->next;
+            deallocate_block(blocks);
+            blocks = next;
+        }
     }
     
-    List(size_t count) : size_(count) {
-        create_fake_node();
+    // Builds [first, last) as a detached chain hanging off the sentinel `chain`.
+    // Nodes are carved out of blocks: a single block of the exact size for forward
+    // iterators, geometrically growing blocks for input iterators. On exception
+    // everything built so far is released and the list itself is not touched.
+    template <typename InputIter>
+    size_t build_chain(InputIter first, InputIter last, BaseNode* chain) {
+        chain->prev = chain->next = chain;
+        NodeBlock* blocks = nullptr;
+        size_t batch = MIN_BATCH_SIZE;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, iterator_category_t<InputIter> >) {
+            batch = static_cast<size_t>(std::distance(first, last));
+        }
+        size_t count = 0;
+        NodeBlock* block = nullptr;
+        try {
+            for (; first != last; ++first) {
+                if (block == nullptr || block->alive == block->capacity) {
+                    if (block != nullptr) {
+                        batch = std::min(batch * 2, MAX_BATCH_SIZE);
+                    }
+                    block = allocate_block(batch);
+                    block->next = blocks;
+                    blocks = block;
+                }
+                Node* node = block->nodes + block->alive;
+                traits_t::construct(node_allocator_, node, *first);
+                node->block = block;
+                ++block->alive;
+                node->prev = chain->prev;
+                node->next = chain;
+                chain->prev->next = node;
+                chain->prev = node;
+                ++count;
+            }
+        } catch (...) {
+            release_chain(chain, blocks);
+            throw;
+        }
+        return count;
+    }
+    
+    BaseNode* splice_chain(BaseNode* after, BaseNode* chain, size_t count) {
+        if (count == 0) {
+            return after;
+        }
+        BaseNode* first = chain->next;
+        BaseNode* before = after->prev;
+        before->next = first;
+        first->prev = before;
+        chain->prev->next = after;
+        after->prev = chain->prev;
+        size_ += count;
+        return first;
+    }
+    
+public:
+    List() : List(NodeAllocator(), 0) {}
+    
+    List(size_t count) : List(NodeAllocator(), 0) {
         for (size_t i = 0; i < count; ++i) {
-            emplace();
+            emplace_back();
         }
     }
     
-    List(size_t count, const T& item) : size_(count) {
-        create_fake_node();
+    List(size_t count, const T& item) : List(NodeAllocator(), 0) {
         for (size_t i = 0; i < count; ++i) {
-            emplace(item);
+            emplace_back(item);
         }
     }
     
@@ -151,45 +406,128 @@ public:
         create_fake_node();
     }
     
-    List(size_t count, const T& item, Allocator allocator)
-        : size_(0), node_allocator_(allocator) {
-        create_fake_node();
+    List(size_t count, const T& item, Allocator allocator) : List(allocator) {
         for (size_t i = 0; i < count; ++i) {
-            emplace(item);
+            emplace_back(item);
         }
     }
     
-    List(size_t count, Allocator allocator)
-        : size_(0), node_allocator_(allocator) {
-        create_fake_node();
+    List(size_t count, Allocator allocator) : List(allocator) {
         for (size_t i = 0; i < count; ++i) {
-            emplace(); 
+            emplace_back();
         }
     }
     
+    template <typename InputIter, typename = enable_if_input_iterator_t<InputIter> >
+    List(InputIter first, InputIter last, Allocator allocator = Allocator()) : List(allocator) {
+        insert(cend(), first, last);
+    }
+    
     List(const List& other)
-        : size_(other.size_),
-          node_allocator_(traits_t::select_on_container_copy_construction(other.node_allocator_)) {
-        create_fake_node();
-        BaseNode* current = other.fake_->next;
-        for (size_t i = 0; i < size_; ++i) {
-            emplace(static_cast<Node*>(current)->value);
-            current = current->next;
-        }
+        : List(traits_t::select_on_container_copy_construction(other.node_allocator_), 0) {
+        insert(cend(), other.cbegin(), other.cend());
+    }
+    
+    List(List&& other) noexcept : List(other.node_allocator_, 0) {
+        take_nodes(other);
     }
     
     List& operator=(const List& other) {
-        size_ = other.size_;
+        if (this == &other) {
+            return *this;
+        }
+        NodeAllocator allocator = node_allocator_;
         if constexpr (traits_t::propagate_on_container_copy_assignment::value) {
+            allocator = other.node_allocator_;
+        }
+        List copy(allocator, 0);
+        copy.insert(copy.cend(), other.cbegin(), other.cend());
+        swap_contents(copy);
+        return *this;
+    }
+    
+    List& operator=(List&& other) noexcept(
+            traits_t::propagate_on_container_move_assignment::value
+            || traits_t::is_always_equal::value) {
+        if (this == &other) {
+            return *this;
+        }
+        if constexpr (traits_t::propagate_on_container_move_assignment::value) {
+            clear();
             node_allocator_ = other.node_allocator_;
+            take_nodes(other);
+        } else {
+            if (traits_t::is_always_equal::value || node_allocator_ == other.node_allocator_) {
+                clear();
+                take_nodes(other);
+            } else {
+                assign(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+                other.clear();
+            }
         }
-        create_fake_node();
-        BaseNode* current = other.fake_->next;
+        return *this;
+    }
+    
+    ~List() {
+        clear();
+    }
+    
+    template <typename InputIter, typename = enable_if_input_iterator_t<InputIter> >
+    void assign(InputIter first, InputIter last) {
+        BaseNode chain;
+        size_t count = build_chain(first, last, &chain);
+        clear();
+        splice_chain(fake_, &chain, count);
+    }
+    
+    void clear() {
+        while (size_ > 0) {
+            pop_back();
+        }
+    }
+    
+    // Moves every element into one freshly allocated block in list order and
+    // relinks them, so traversal walks memory sequentially again after many
+    // scattered inserts and erases. Invalidates all iterators. Elements are
+    // moved if that can't throw and copied otherwise, so if one throws, the
+    // list is left unchanged. The exception is a move-only T whose move may
+    // throw: it is still moved, and the elements moved before the throw stay
+    // in the list in their moved-from state.
+    void compact() {
+        if (size_ == 0) {
+            return;
+        }
+        NodeBlock* block = allocate_block(size_);
+        try {
+            for (BaseNode* current = fake_->next; current != fake_; current = current->next) {
+                traits_t::construct(
+                    node_allocator_,
+                    block->nodes + block->alive,
+                    std::move_if_noexcept(static_cast<Node*>(current)->value)
+                );
+                ++block->alive;
+            }
+        } catch (...) {
+            for (size_t i = 0; i < block->alive; ++i) {
+                traits_t::destroy(node_allocator_, block->nodes + i);
+            }
+            deallocate_block(block);
+            throw;
+        }
+        BaseNode* current = fake_->next;
+        BaseNode* prev = fake_;
         for (size_t i = 0; i < size_; ++i) {
-            emplace(static_cast<Node*>(current)->value);
-            current = current->next;
+            BaseNode* next = current->next;
+            destroy_node(current);
+            block->nodes[i].block = block;
+            BaseNode* node = block->nodes + i;
+            node->prev = prev;
+            prev->next = node;
+            prev = node;
+            current = next;
         }
-        return *this;
+        prev->next = fake_;
+        fake_->prev = prev;
     }
     
     NodeAllocator get_allocator() const {
@@ -200,31 +538,35 @@ public:
         return size_;
     }
     
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        return *emplace(cend(), std::forward<Args>(args)...);
+    }
+    
+    template <typename... Args>
+    T& emplace_front(Args&&... args) {
+        return *emplace(cbegin(), std::forward<Args>(args)...);
+    }
+    
     void push_back(const T& item) {
-        emplace(item);
-        ++size_;
+        emplace_back(item);
+    }
+    
+    void push_back(T&& item) {
+        emplace_back(std::move(item));
     }
     
     void push_front(const T& item) {
-        BaseNode* begin = fake_->next;
-        fake_->next = traits_t::allocate(node_allocator_, 1);
-        try {
-            traits_t::construct(node_allocator_, static_cast<Node*>(fake_->next), item);
-        } catch (...) {
-            traits_t::deallocate(node_allocator_, static_cast<Node*>(fake_->next), 1);
-            fake_->next = begin;
-            throw;
-        }
-        fake_->next->prev = fake_;
-        fake_->next->next = begin;
-        begin->prev = fake_->next;
-        ++size_;
+        emplace_front(item);
+    }
+    
+    void push_front(T&& item) {
+        emplace_front(std::move(item));
     }
     
     void pop_back() {
         BaseNode* new_end = fake_->prev->prev;
-        traits_t::destroy(node_allocator_, static_cast<Node*>(new_end->next));
-        traits_t::deallocate(node_allocator_, static_cast<Node*>(new_end->next), 1);
+        destroy_node(new_end->next);
         new_end->next = fake_;
         fake_->prev = new_end;
         --size_;
@@ -232,8 +574,7 @@ public:
     
     void pop_front() {
         BaseNode* new_begin = fake_->next->next;
-        traits_t::destroy(node_allocator_, static_cast<Node*>(new_begin->prev));
-        traits_t::deallocate(node_allocator_, static_cast<Node*>(new_begin->prev), 1);
+        destroy_node(new_begin->prev);
         new_begin->prev = fake_;
         fake_->next = new_begin;
         --size_;
@@ -285,15 +626,21 @@ public:
             return result;
         }
         
-        std::conditional_t<IsConst, const T&, T&> operator*() const {
+        reference operator*() const {
             return static_cast<Node*>(position_)->value;
         }
         
-        bool operator==(CommonIterator other) const {
+        pointer operator->() const {
+            return &(static_cast<Node*>(position_)->value);
+        }
+        
+        template <bool IsConstOther>
+        bool operator==(CommonIterator<IsConstOther> other) const {
             return position_ == other.position_;
         }
         
-        bool operator!=(CommonIterator other) const {
+        template <bool IsConstOther>
+        bool operator!=(CommonIterator<IsConstOther> other) const {
             return !(*this == other);
         }
         
@@ -326,26 +673,31 @@ public:
     }
     
     reverse_iterator rbegin() const noexcept {
-        return reverse_iterator(iterator(fake_->prev));
+        return reverse_iterator(iterator(fake_));
     }
     
     reverse_iterator rend() const noexcept {
-        return reverse_iterator(iterator(fake_));
+        return reverse_iterator(iterator(fake_->next));
     }
     
     const_reverse_iterator crbegin() const noexcept {
-        return const_reverse_iterator(const_iterator(fake_->prev));
+        return const_reverse_iterator(const_iterator(fake_));
     }
     
     const_reverse_iterator crend() const noexcept {
-        return const_reverse_iterator(const_iterator(fake_));
+        return const_reverse_iterator(const_iterator(fake_->next));
     }
     
-    iterator insert(const_iterator iter, const T& item) {
+    template <typename... Args>
+    iterator emplace(const_iterator iter, Args&&... args) {
         BaseNode* after = iter.position_;
         BaseNode* inserted = traits_t::allocate(node_allocator_, 1);
         try {
-            traits_t::construct(node_allocator_, static_cast<Node*>(inserted), item);
+            traits_t::construct(
+                node_allocator_,
+                static_cast<Node*>(inserted),
+                std::forward<Args>(args)...
+            );
         } catch (...) {
             traits_t::deallocate(node_allocator_, static_cast<Node*>(inserted), 1);
             throw;
@@ -358,14 +710,31 @@ public:
         return iterator(inserted);
     }
     
-    void erase(const_iterator iter) {
+    iterator insert(const_iterator iter, const T& item) {
+        return emplace(iter, item);
+    }
+    
+    iterator insert(const_iterator iter, T&& item) {
+        return emplace(iter, std::move(item));
+    }
+    
+    // Inserts [first, last) before iter. The new nodes are allocated in batches
+    // and linked in one pass; if anything throws, the list is left unchanged.
+    template <typename InputIter, typename = enable_if_input_iterator_t<InputIter> >
+    iterator insert(const_iterator iter, InputIter first, InputIter last) {
+        BaseNode chain;
+        size_t count = build_chain(first, last, &chain);
+        return iterator(splice_chain(iter.position_, &chain, count));
+    }
+    
+    iterator erase(const_iterator iter) {
         BaseNode* to_delete = iter.position_;
         BaseNode* before = to_delete->prev;
         BaseNode* after = to_delete->next;
-        traits_t::destroy(node_allocator_, static_cast<Node*>(to_delete));
-        traits_t::deallocate(node_allocator_, static_cast<Node*>(to_delete), 1);
+        destroy_node(to_delete);
         before->next = after;
         after->prev = before;
         --size_;
+        return iterator(after);
     }
 };
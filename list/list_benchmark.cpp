@@ -0,0 +1,514 @@
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <sstream>
+#include <set>
+#include <optional>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <cassert>
+
+#include "list.h"
+#include "concurrent_queue.h"
+#include "deque.h"
+#include "small_vector.h"
+#include "parallel_algorithms.h"
+#include "skip_list.h"
+#include "persistent_list.h"
+
+constexpr size_t STORAGE_SIZE = 200'000'000;
+
+template <typename Func>
+long long Measure(Func&& func) {
+    using namespace std::chrono;
+
+    auto start = high_resolution_clock::now();
+    func();
+    auto finish = high_resolution_clock::now();
+    return duration_cast<milliseconds>(finish - start).count();
+}
+
+template <typename Func>
+void Report(const std::string& name, Func&& func) {
+    std::ostringstream oss;
+    for (int i = 0; i < 3; ++i) {
+        oss << Measure(func) << " ";
+    }
+    std::cerr << " " << name << ": " << oss.str() << "ms" << std::endl;
+}
+
+struct ExpensiveToCopy {
+    std::vector<int> payload;
+
+    explicit ExpensiveToCopy(int value) : payload(256, value) {}
+};
+
+void BenchmarkExpensiveToCopy() {
+    const int count = 200'000;
+
+    Report("push_back(const T&) of 1 KiB objects", [&] {
+        List<ExpensiveToCopy> lst;
+        for (int i = 0; i < count; ++i) {
+            ExpensiveToCopy item(i);
+            lst.push_back(item);
+        }
+    });
+
+    Report("push_back(T&&) of 1 KiB objects", [&] {
+        List<ExpensiveToCopy> lst;
+        for (int i = 0; i < count; ++i) {
+            ExpensiveToCopy item(i);
+            lst.push_back(std::move(item));
+        }
+    });
+
+    Report("emplace_back of 1 KiB objects", [&] {
+        List<ExpensiveToCopy> lst;
+        for (int i = 0; i < count; ++i) {
+            lst.emplace_back(i);
+        }
+    });
+
+    List<ExpensiveToCopy> source;
+    for (int i = 0; i < count; ++i) {
+        source.emplace_back(i);
+    }
+
+    Report("copy assignment of 1 KiB objects", [&] {
+        List<ExpensiveToCopy> lst;
+        lst = source;
+        assert(lst.size() == source.size());
+    });
+
+    Report("move assignment of 1 KiB objects", [&] {
+        List<ExpensiveToCopy> lst;
+        lst = std::move(source);
+        source = std::move(lst);
+        assert(source.size() == static_cast<size_t>(count));
+    });
+}
+
+void BenchmarkMoveOnly() {
+    const int count = 1'000'000;
+
+    Report("emplace_back of std::unique_ptr", [&] {
+        List<std::unique_ptr<int>> lst;
+        for (int i = 0; i < count; ++i) {
+            lst.emplace_back(std::make_unique<int>(i));
+        }
+    });
+
+    Report("emplace_back of std::unique_ptr with StackAllocator", [&] {
+        using Alloc = StackAllocator<std::unique_ptr<int>, STORAGE_SIZE>;
+        StackStorage<STORAGE_SIZE>* storage = new StackStorage<STORAGE_SIZE>;
+        {
+            List<std::unique_ptr<int>, Alloc> lst{Alloc(*storage)};
+            for (int i = 0; i < count; ++i) {
+                lst.emplace_back(std::make_unique<int>(i));
+            }
+        }
+        delete storage;
+    });
+}
+
+void BenchmarkRangeInsert() {
+    const int count = 2'000'000;
+    std::vector<int> source(count);
+    for (int i = 0; i < count; ++i) {
+        source[i] = i;
+    }
+
+    Report("push_back one by one", [&] {
+        List<int> lst;
+        for (int x: source) {
+            lst.push_back(x);
+        }
+    });
+
+    Report("range constructor", [&] {
+        List<int> lst(source.begin(), source.end());
+        assert(lst.size() == source.size());
+    });
+
+    Report("copy constructor", [&] {
+        static List<int> lst(source.begin(), source.end());
+        List<int> copy = lst;
+        assert(copy.size() == source.size());
+    });
+}
+
+// Inserts before random earlier elements, so list order and memory order diverge.
+List<int> MakeScatteredList(int count) {
+    List<int> lst;
+    std::vector<List<int>::iterator> positions;
+    positions.reserve(count);
+    std::mt19937 gen(42);
+    positions.push_back(lst.insert(lst.cend(), 0));
+    for (int i = 1; i < count; ++i) {
+        auto pos = positions[gen() % positions.size()];
+        positions.push_back(lst.insert(pos, i));
+    }
+    return lst;
+}
+
+void BenchmarkCompact() {
+    const int count = 4'000'000;
+    List<int> lst = MakeScatteredList(count);
+
+    long long sum = 0;
+    auto traverse = [&] {
+        sum = 0;
+        for (int x: lst) {
+            sum += x;
+        }
+    };
+
+    Report("traversal of a scattered list", traverse);
+    long long before = sum;
+
+    Report("compact()", [&] {
+        lst.compact();
+    });
+
+    Report("traversal after compact()", traverse);
+    assert(sum == before);
+}
+
+// A List guarded by a mutex, the baseline that ConcurrentQueue replaces.
+class LockedListQueue {
+private:
+    List<int> list_;
+    std::mutex mutex_;
+
+public:
+    void push(int item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        list_.push_back(item);
+    }
+
+    bool try_pop(int& item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (list_.size() == 0) {
+            return false;
+        }
+        item = *list_.begin();
+        list_.pop_front();
+        return true;
+    }
+};
+
+// Returns millions of operations (pushes plus pops) per second.
+template <typename Queue>
+double QueueThroughput(int producers, int consumers, int items_per_producer) {
+    Queue queue;
+    std::atomic<int> popped{0};
+    const int total = producers * items_per_producer;
+
+    auto ms = Measure([&] {
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; ++p) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < items_per_producer; ++i) {
+                    queue.push(i);
+                }
+            });
+        }
+        for (int c = 0; c < consumers; ++c) {
+            threads.emplace_back([&] {
+                int item;
+                while (popped.load(std::memory_order_relaxed) < total) {
+                    if (queue.try_pop(item)) {
+                        popped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            });
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+    });
+    return 2.0 * total / 1000.0 / std::max<long long>(ms, 1);
+}
+
+void BenchmarkConcurrentQueue() {
+    const int items = 1'000'000;
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        std::cerr << " " << threads << " producers / " << threads << " consumers:"
+                  << " List + mutex " << QueueThroughput<LockedListQueue>(threads, threads, items / threads)
+                  << " Mops/s, ConcurrentQueue "
+                  << QueueThroughput<ConcurrentQueue<int>>(threads, threads, items / threads)
+                  << " Mops/s" << std::endl;
+    }
+}
+
+// A FIFO that keeps `backlog` items queued while `operations` items pass through.
+template <typename Queue>
+long long RunFifo(Queue&& queue, int backlog, int operations) {
+    long long sum = 0;
+    for (int i = 0; i < backlog; ++i) {
+        queue.push_back(i);
+    }
+    for (int i = 0; i < operations; ++i) {
+        queue.push_back(i);
+        sum += *queue.begin();
+        queue.pop_front();
+    }
+    while (queue.size() > 0) {
+        sum += *queue.begin();
+        queue.pop_front();
+    }
+    return sum;
+}
+
+void BenchmarkQueueWorkloads() {
+    const int operations = 5'000'000;
+    using Alloc = StackAllocator<int, STORAGE_SIZE>;
+
+    for (int backlog: {100, 1'000'000}) {
+        std::cerr << " backlog of " << backlog << ":" << std::endl;
+
+        Report("List<int>", [&] {
+            RunFifo(List<int>(), backlog, operations);
+        });
+
+        Report("Deque<int>", [&] {
+            RunFifo(Deque<int>(), backlog, operations);
+        });
+
+        Report("List<int, StackAllocator>", [&] {
+            auto storage = std::make_unique<StackStorage<STORAGE_SIZE>>();
+            RunFifo(List<int, Alloc>(Alloc(*storage)), backlog, operations);
+        });
+
+        Report("Deque<int, StackAllocator>", [&] {
+            auto storage = std::make_unique<StackStorage<STORAGE_SIZE>>();
+            RunFifo(Deque<int, Alloc>(Alloc(*storage)), backlog, operations);
+        });
+    }
+}
+
+// Builds, reads and drops `repeats` collections of `size` ints each, the life
+// cycle of a small per-request collection.
+template <typename Container>
+long long RunSmallCollections(int size, int repeats) {
+    long long sum = 0;
+    for (int r = 0; r < repeats; ++r) {
+        Container items;
+        for (int i = 0; i < size; ++i) {
+            items.push_back(r + i);
+        }
+        for (int x: items) {
+            sum += x;
+        }
+    }
+    return sum;
+}
+
+void BenchmarkSmallCollections() {
+    const int repeats = 2'000'000;
+    for (int size: {1, 4, 8, 16}) {
+        std::cerr << " " << size << " elements:" << std::endl;
+
+        Report("List<int>", [&] {
+            RunSmallCollections<List<int>>(size, repeats);
+        });
+
+        Report("std::vector<int>", [&] {
+            RunSmallCollections<std::vector<int>>(size, repeats);
+        });
+
+        Report("SmallVector<int, 8>", [&] {
+            RunSmallCollections<SmallVector<int, 8>>(size, repeats);
+        });
+    }
+}
+
+void BenchmarkParallelTraversal() {
+    const int count = 4'000'000;
+    List<int> lst = MakeScatteredList(count);
+    auto is_odd = [](int x) { return x % 2 == 1; };
+
+    Report("sequential sum", [&] {
+        long long sum = 0;
+        for (int x: lst) {
+            sum += x;
+        }
+        assert(sum == 1LL * count * (count - 1) / 2);
+    });
+
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        ThreadPool pool(threads);
+        std::cerr << " " << threads << " threads:" << std::endl;
+
+        std::optional<Chunks<List<int>::iterator> > chunks;
+        Report("split into chunks", [&] {
+            chunks.emplace(make_chunks(lst, default_chunk_count(pool)));
+        });
+
+        Report("parallel_reduce over chunks", [&] {
+            long long sum = parallel_reduce(pool, *chunks, 0LL, std::plus<long long>());
+            assert(sum == 1LL * count * (count - 1) / 2);
+        });
+
+        Report("parallel_count_if over chunks", [&] {
+            parallel_count_if(pool, *chunks, is_odd);
+        });
+
+        // Report runs it three times, the fourth call below restores the list.
+        Report("parallel_for_each over chunks", [&] {
+            parallel_for_each(pool, *chunks, [](int& x) { x = -x; });
+        });
+        parallel_for_each(pool, *chunks, [](int& x) { x = -x; });
+
+        Report("one-off parallel_reduce (split included)", [&] {
+            parallel_reduce(pool, lst, 0LL, std::plus<long long>());
+        });
+    }
+}
+
+// Inserts and looks up random keys in an ordered container. A sorted List
+// needs a linear scan for both, the baseline that SkipList replaces.
+template <typename Container>
+void RunOrderedLookups(const std::string& name, int count, int lookups) {
+    std::mt19937 gen(17);
+    Container container;
+    Report(name + " insert", [&] {
+        container = Container();
+        for (int i = 0; i < count; ++i) {
+            int key = gen() % (4 * count);
+            if constexpr (std::is_same_v<Container, List<int> >) {
+                auto pos = container.begin();
+                while (pos != container.end() && *pos < key) {
+                    ++pos;
+                }
+                if (pos == container.end() || *pos != key) {
+                    container.insert(pos, key);
+                }
+            } else {
+                container.insert(key);
+            }
+        }
+    });
+    long long sum = 0;
+    Report(name + " lower_bound", [&] {
+        sum = 0;
+        for (int i = 0; i < lookups; ++i) {
+            int key = gen() % (4 * count);
+            if constexpr (std::is_same_v<Container, List<int> >) {
+                auto pos = container.begin();
+                while (pos != container.end() && *pos < key) {
+                    ++pos;
+                }
+                sum += pos == container.end() ? 0 : *pos;
+            } else {
+                auto pos = container.lower_bound(key);
+                sum += pos == container.end() ? 0 : *pos;
+            }
+        }
+    });
+    assert(sum > 0);
+}
+
+void BenchmarkOrderedContainers() {
+    const int small = 20'000;
+    const int large = 1'000'000;
+
+    std::cerr << " " << small << " keys:" << std::endl;
+    RunOrderedLookups<List<int> >("sorted List", small, small);
+    RunOrderedLookups<SkipList<int> >("SkipList", small, small);
+    RunOrderedLookups<std::set<int> >("std::set", small, small);
+
+    std::cerr << " " << large << " keys:" << std::endl;
+    RunOrderedLookups<SkipList<int> >("SkipList", large, large);
+    RunOrderedLookups<std::set<int> >("std::set", large, large);
+}
+
+// A writer that prepends and hands a snapshot to readers every `period` items.
+void BenchmarkSnapshots() {
+    const int count = 1'000'000;
+    const int period = 100'000;
+
+    Report("List: push_front + copy every 100k", [&] {
+        List<int> lst;
+        std::vector<List<int> > snapshots;
+        for (int i = 0; i < count; ++i) {
+            lst.push_front(i);
+            if (i % period == 0) {
+                snapshots.push_back(lst);
+            }
+        }
+    });
+
+    Report("PersistentList: push_front + snapshot every 100k", [&] {
+        PersistentList<int> lst;
+        std::vector<PersistentList<int> > snapshots;
+        for (int i = 0; i < count; ++i) {
+            lst.push_front(i);
+            if (i % period == 0) {
+                snapshots.push_back(lst);
+            }
+        }
+    });
+
+    List<int> lst;
+    PersistentList<int> persistent;
+    for (int i = 0; i < count; ++i) {
+        lst.push_front(i);
+        persistent.push_front(i);
+    }
+
+    Report("one List copy of 1M", [&] {
+        List<int> copy = lst;
+    });
+
+    Report("one PersistentList snapshot of 1M", [&] {
+        PersistentList<int> copy = persistent;
+    });
+
+    long long sum = 0;
+    Report("traversal of a PersistentList snapshot", [&] {
+        PersistentList<int> copy = persistent;
+        sum = std::accumulate(copy.begin(), copy.end(), 0LL);
+    });
+    assert(sum == 1LL * count * (count - 1) / 2);
+}
+
+int main() {
+    std::cerr << "Element types that are expensive to copy:" << std::endl;
+    BenchmarkExpensiveToCopy();
+
+    std::cerr << "Move-only element types:" << std::endl;
+    BenchmarkMoveOnly();
+
+    std::cerr << "Batched range insert:" << std::endl;
+    BenchmarkRangeInsert();
+
+    std::cerr << "Memory-order compaction:" << std::endl;
+    BenchmarkCompact();
+
+    std::cerr << "MPMC queue throughput:" << std::endl;
+    BenchmarkConcurrentQueue();
+
+    std::cerr << "Single-threaded FIFO, List vs Deque:" << std::endl;
+    BenchmarkQueueWorkloads();
+
+    std::cerr << "Small collections, List vs std::vector vs SmallVector:" << std::endl;
+    BenchmarkSmallCollections();
+
+    std::cerr << "Parallel traversal of a scattered List:" << std::endl;
+    BenchmarkParallelTraversal();
+
+    std::cerr << "Ordered containers:" << std::endl;
+    BenchmarkOrderedContainers();
+
+    std::cerr << "Snapshots for readers:" << std::endl;
+    BenchmarkSnapshots();
+}
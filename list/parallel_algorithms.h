@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Fixed set of worker threads. run(count, task) calls task(0), ..., task(count - 1)
+// spread over the workers and the calling thread, and returns once all of them are
+// done, rethrowing the first exception any of them threw. The caller takes part in
+// the work and never waits for a worker that has not started yet, so run may be
+// called from inside a task without deadlocking the pool.
+class ThreadPool {
+private:
+    struct Job {
+        std::function<void(size_t)> task;
+        size_t count;
+        std::atomic<size_t> next{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t active = 0;
+        bool closed = false;
+        std::exception_ptr error;
+
+        // Returns false if the job was already over.
+        bool enter() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed) {
+                return false;
+            }
+            ++active;
+            return true;
+        }
+
+        void leave() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0) {
+                finished.notify_all();
+            }
+        }
+
+        void work() {
+            for (size_t index = next++; index < count; index = next++) {
+                try {
+                    task(index);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    next = count;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()> > queue_;
+    std::mutex mutex_;
+    std::condition_variable available_;
+    bool stopping_ = false;
+
+    void worker_loop() {
+        while (true) {
+            std::function<void()> item;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                available_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty()) {
+                    return;
+                }
+                item = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            item();
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+        threads = std::max<size_t>(threads, 1);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { worker_loop(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        available_.notify_all();
+        for (auto& worker: workers_) {
+            worker.join();
+        }
+    }
+
+    size_t size() const {
+        return workers_.size();
+    }
+
+    template <typename Func>
+    void run(size_t count, Func&& task) {
+        auto job = std::make_shared<Job>();
+        job->task = std::ref(task);
+        job->count = count;
+        size_t helpers = std::min(count, workers_.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < helpers; ++i) {
+                queue_.emplace_back([job] {
+                    if (job->enter()) {
+                        job->work();
+                        job->leave();
+                    }
+                });
+            }
+        }
+        available_.notify_all();
+        job->work();
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job] { return job->active == 0; });
+        job->closed = true;
+        if (job->error) {
+            std::rethrow_exception(job->error);
+        }
+    }
+};
+
+// Split points of a sequence into `count` chunks of nearly equal length, found
+// with a single walk. For a List they stay valid as long as the boundary
+// elements are not erased: inserts only make the chunks uneven. So a list that is
+// reduced many times pays for the walk once and then traverses in parallel.
+template <typename Iter>
+class Chunks {
+private:
+    std::vector<Iter> bounds_;
+
+public:
+    Chunks(Iter first, size_t size, size_t count) {
+        count = std::max<size_t>(std::min(count, size), 1);
+        bounds_.reserve(count + 1);
+        bounds_.push_back(first);
+        for (size_t chunk = 0; chunk < count; ++chunk) {
+            size_t length = size / count + (chunk < size % count ? 1 : 0);
+            for (size_t i = 0; i < length; ++i) {
+                ++first;
+            }
+            bounds_.push_back(first);
+        }
+    }
+
+    size_t size() const {
+        return bounds_.size() - 1;
+    }
+
+    Iter begin(size_t chunk) const {
+        return bounds_[chunk];
+    }
+
+    Iter end(size_t chunk) const {
+        return bounds_[chunk + 1];
+    }
+};
+
+template <typename T>
+struct is_chunks : std::false_type {};
+
+template <typename Iter>
+struct is_chunks<Chunks<Iter> > : std::true_type {};
+
+// A few chunks per thread, so that a slow chunk doesn't leave the others idle.
+inline size_t default_chunk_count(const ThreadPool& pool) {
+    return 4 * pool.size();
+}
+
+template <typename Container>
+auto make_chunks(Container& container, size_t count) {
+    return Chunks<decltype(container.begin())>(container.begin(), container.size(), count);
+}
+
+template <typename Iter, typename Func>
+void parallel_for_each(ThreadPool& pool, const Chunks<Iter>& chunks, Func func) {
+    pool.run(chunks.size(), [&](size_t chunk) {
+        for (Iter it = chunks.begin(chunk); it != chunks.end(chunk); ++it) {
+            func(*it);
+        }
+    });
+}
+
+// Reduces every chunk on its own and then folds the partial results left to
+// right into init, so op must be associative but need not be commutative.
+template <typename Iter, typename T, typename BinaryOp>
+T parallel_reduce(ThreadPool& pool, const Chunks<Iter>& chunks, T init, BinaryOp op) {
+    std::vector<std::optional<T> > partial(chunks.size());
+    pool.run(chunks.size(), [&](size_t chunk) {
+        Iter it = chunks.begin(chunk);
+        Iter end = chunks.end(chunk);
+        if (it == end) {
+            return;
+        }
+        T result = *it;
+        for (++it; it != end; ++it) {
+            result = op(std::move(result), *it);
+        }
+        partial[chunk] = std::move(result);
+    });
+    for (auto& result: partial) {
+        if (result) {
+            init = op(std::move(init), std::move(*result));
+        }
+    }
+    return init;
+}
+
+template <typename Iter, typename Predicate>
+size_t parallel_count_if(ThreadPool& pool, const Chunks<Iter>& chunks, Predicate pred) {
+    std::vector<size_t> partial(chunks.size());
+    pool.run(chunks.size(), [&](size_t chunk) {
+        size_t result = 0;
+        for (Iter it = chunks.begin(chunk); it != chunks.end(chunk); ++it) {
+            if (pred(*it)) {
+                ++result;
+            }
+        }
+        partial[chunk] = result;
+    });
+    size_t result = 0;
+    for (size_t count: partial) {
+        result += count;
+    }
+    return result;
+}
+
+// One-off versions: they split the container first, which is itself a full
+// sequential walk, so they only pay off when the per-element work is heavy.
+template <typename Container, typename Func,
+          typename = std::enable_if_t<!is_chunks<std::remove_const_t<Container> >::value> >
+void parallel_for_each(ThreadPool& pool, Container& container, Func func) {
+    parallel_for_each(pool, make_chunks(container, default_chunk_count(pool)), std::move(func));
+}
+
+template <typename Container, typename T, typename BinaryOp>
+T parallel_reduce(ThreadPool& pool, const Container& container, T init, BinaryOp op) {
+    return parallel_reduce(pool, make_chunks(container, default_chunk_count(pool)),
+                           std::move(init), std::move(op));
+}
+
+template <typename Container, typename Predicate>
+size_t parallel_count_if(ThreadPool& pool, const Container& container, Predicate pred) {
+    return parallel_count_if(pool, make_chunks(container, default_chunk_count(pool)),
+                             std::move(pred));
+}
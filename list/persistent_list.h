@@ -0,0 +1,247 @@
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// Immutable singly linked list whose versions share structure. Copying a
+// PersistentList is a snapshot: it costs one reference count increment, however
+// long the list is, and later changes to either copy are invisible to the other.
+// push_front and pop_front are O(1) and only ever change the handle they are
+// called on: the new version points at the old nodes, which are never modified
+// once linked, so every version that is still referenced stays intact.
+//
+// Reference counts are atomic, so snapshots can be handed to reader threads and
+// dropped there. One handle must still not be used from two threads at once.
+template <typename T, typename Allocator = std::allocator<T> >
+class PersistentList {
+private:
+    struct Node {
+        T value;
+        Node* next;
+        std::atomic<size_t> refs;
+
+        template <typename... Args>
+        Node(Node* next, Args&&... args)
+            : value(std::forward<Args>(args)...), next(next), refs(1) {}
+    };
+
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+    using traits_t = std::allocator_traits<NodeAllocator>;
+
+    Node* head_;
+    size_t size_;
+    NodeAllocator node_allocator_;
+
+    static Node* acquire(Node* node) noexcept {
+        if (node != nullptr) {
+            node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    // Drops one reference to node and frees every node that becomes unreachable
+    // with it. The walk is iterative, so dropping a long list can't overflow the
+    // stack.
+    void release(Node* node) noexcept {
+        while (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Node* next = node->next;
+            traits_t::destroy(node_allocator_, node);
+            traits_t::deallocate(node_allocator_, node, 1);
+            node = next;
+        }
+    }
+
+    template <typename... Args>
+    Node* create_node(Node* next, Args&&... args) {
+        Node* node = traits_t::allocate(node_allocator_, 1);
+        try {
+            traits_t::construct(node_allocator_, node, next, std::forward<Args>(args)...);
+        } catch (...) {
+            traits_t::deallocate(node_allocator_, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    PersistentList(Node* head, size_t size, const NodeAllocator& allocator) noexcept
+        : head_(head), size_(size), node_allocator_(allocator) {}
+
+public:
+    PersistentList() : head_(nullptr), size_(0), node_allocator_() {}
+
+    PersistentList(Allocator allocator) : head_(nullptr), size_(0), node_allocator_(allocator) {}
+
+    // Builds the list in the order of [first, last). The nodes are not shared
+    // yet, so they can still be appended one after another.
+    template <typename InputIter, typename = std::enable_if_t<std::is_base_of_v<
+        std::input_iterator_tag, typename std::iterator_traits<InputIter>::iterator_category> > >
+    PersistentList(InputIter first, InputIter last, Allocator allocator = Allocator())
+        : PersistentList(allocator) {
+        Node** tail = &head_;
+        try {
+            for (; first != last; ++first) {
+                *tail = create_node(nullptr, *first);
+                tail = &(*tail)->next;
+                ++size_;
+            }
+        } catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    PersistentList(const PersistentList& other) noexcept
+        : head_(acquire(other.head_)), size_(other.size_), node_allocator_(other.node_allocator_) {}
+
+    PersistentList(PersistentList&& other) noexcept
+        : head_(std::exchange(other.head_, nullptr))
+        , size_(std::exchange(other.size_, 0))
+        , node_allocator_(other.node_allocator_) {}
+
+    // Nodes are shared between versions, so all of them keep the allocator the
+    // nodes were made with, whatever the propagation traits say.
+    PersistentList& operator=(const PersistentList& other) noexcept {
+        PersistentList copy(other);
+        swap(copy);
+        return *this;
+    }
+
+    PersistentList& operator=(PersistentList&& other) noexcept {
+        PersistentList moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~PersistentList() {
+        release(head_);
+    }
+
+    void swap(PersistentList& other) noexcept {
+        std::swap(head_, other.head_);
+        std::swap(size_, other.size_);
+        std::swap(node_allocator_, other.node_allocator_);
+    }
+
+    Allocator get_allocator() const {
+        return Allocator(node_allocator_);
+    }
+
+    size_t size() const noexcept {
+        return size_;
+    }
+
+    bool empty() const noexcept {
+        return size_ == 0;
+    }
+
+    const T& front() const {
+        return head_->value;
+    }
+
+    // The list without its first element, sharing all of its nodes.
+    PersistentList tail() const noexcept {
+        return PersistentList(acquire(head_->next), size_ - 1, node_allocator_);
+    }
+
+    // A version with item in front of this one; this one is unchanged.
+    template <typename... Args>
+    PersistentList with_front(Args&&... args) const {
+        PersistentList result(*this);
+        result.emplace_front(std::forward<Args>(args)...);
+        return result;
+    }
+
+    template <typename... Args>
+    void emplace_front(Args&&... args) {
+        head_ = create_node(head_, std::forward<Args>(args)...);
+        ++size_;
+    }
+
+    void push_front(const T& item) {
+        emplace_front(item);
+    }
+
+    void push_front(T&& item) {
+        emplace_front(std::move(item));
+    }
+
+    void pop_front() noexcept {
+        Node* old_head = head_;
+        head_ = acquire(old_head->next);
+        --size_;
+        release(old_head);
+    }
+
+    void clear() noexcept {
+        release(std::exchange(head_, nullptr));
+        size_ = 0;
+    }
+
+    // True if both handles are the same version.
+    bool shares_with(const PersistentList& other) const noexcept {
+        return head_ == other.head_;
+    }
+
+    class Iterator {
+    private:
+        const Node* position_;
+
+    public:
+        using value_type = T;
+        using pointer = const T*;
+        using reference = const T&;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        Iterator(const Node* position) : position_(position) {}
+
+        Iterator& operator++() {
+            position_ = position_->next;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator result = *this;
+            position_ = position_->next;
+            return result;
+        }
+
+        reference operator*() const {
+            return position_->value;
+        }
+
+        pointer operator->() const {
+            return &position_->value;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return position_ == other.position_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    using iterator = Iterator;
+    using const_iterator = Iterator;
+
+    iterator begin() const noexcept {
+        return iterator(head_);
+    }
+
+    iterator end() const noexcept {
+        return iterator(nullptr);
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    const_iterator cend() const noexcept {
+        return end();
+    }
+};
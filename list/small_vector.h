@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Vector that keeps its first N elements inside the object and only goes to
+// Allocator once it outgrows them. A collection of a handful of elements thus
+// costs no allocation at all, where a List pays one node allocation per element
+// and std::vector one for the buffer. Beyond N it behaves like std::vector:
+// capacity doubles, elements are moved if their move constructor is noexcept
+// and copied otherwise, and a throwing reallocation leaves it untouched.
+//
+// Moving a SmallVector whose elements are inline moves them one by one, so
+// unlike std::vector a move may invalidate iterators and is only as noexcept
+// as T's move constructor.
+template <typename T, size_t N, typename Allocator = std::allocator<T> >
+class SmallVector {
+private:
+    using ElementAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+    using traits_t = std::allocator_traits<ElementAllocator>;
+
+    alignas(T) unsigned char inline_[(N > 0 ? N : 1) * sizeof(T)];
+    T* data_;
+    size_t size_;
+    size_t capacity_;
+    ElementAllocator allocator_;
+
+    T* inline_data() noexcept {
+        return reinterpret_cast<T*>(inline_);
+    }
+
+    void destroy_elements() noexcept {
+        for (size_t i = size_; i > 0; --i) {
+            traits_t::destroy(allocator_, data_ + i - 1);
+        }
+        size_ = 0;
+    }
+
+    void release_buffer() noexcept {
+        if (!is_inline()) {
+            traits_t::deallocate(allocator_, data_, capacity_);
+        }
+        data_ = inline_data();
+        capacity_ = N;
+    }
+
+    // Moves the elements into a buffer of new_capacity; if inserted is not null,
+    // it is called first to construct one more element at position size_ in the
+    // new buffer, so that arguments referring to our own elements stay valid.
+    template <typename Inserter = std::nullptr_t>
+    void reallocate(size_t new_capacity, Inserter inserted = nullptr) {
+        T* buffer = traits_t::allocate(allocator_, new_capacity);
+        size_t constructed = 0;
+        bool inserted_constructed = false;
+        try {
+            if constexpr (!std::is_same_v<Inserter, std::nullptr_t>) {
+                inserted(buffer + size_);
+                inserted_constructed = true;
+            }
+            for (; constructed < size_; ++constructed) {
+                traits_t::construct(allocator_, buffer + constructed,
+                                    std::move_if_noexcept(data_[constructed]));
+            }
+        } catch (...) {
+            for (size_t i = 0; i < constructed; ++i) {
+                traits_t::destroy(allocator_, buffer + i);
+            }
+            if (inserted_constructed) {
+                traits_t::destroy(allocator_, buffer + size_);
+            }
+            traits_t::deallocate(allocator_, buffer, new_capacity);
+            throw;
+        }
+        size_t size = size_;
+        destroy_elements();
+        release_buffer();
+        data_ = buffer;
+        size_ = size;
+        capacity_ = new_capacity;
+    }
+
+    size_t grown_capacity(size_t needed) const {
+        return std::max(2 * capacity_, needed);
+    }
+
+    // Takes the elements of other, which must use an allocator equal to ours.
+    // This vector must be empty and inline.
+    void take_contents(SmallVector& other) {
+        if (other.is_inline()) {
+            for (; size_ < other.size_; ++size_) {
+                traits_t::construct(allocator_, data_ + size_, std::move(other.data_[size_]));
+            }
+            other.destroy_elements();
+        } else {
+            data_ = std::exchange(other.data_, other.inline_data());
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, N);
+        }
+    }
+
+public:
+    SmallVector() : data_(inline_data()), size_(0), capacity_(N), allocator_() {}
+
+    SmallVector(Allocator allocator)
+        : data_(inline_data()), size_(0), capacity_(N), allocator_(allocator) {}
+
+    SmallVector(size_t count, Allocator allocator = Allocator()) : SmallVector(allocator) {
+        resize(count);
+    }
+
+    SmallVector(size_t count, const T& item, Allocator allocator = Allocator())
+        : SmallVector(allocator) {
+        reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            emplace_back(item);
+        }
+    }
+
+    template <typename InputIter, typename = std::enable_if_t<std::is_base_of_v<
+        std::input_iterator_tag, typename std::iterator_traits<InputIter>::iterator_category> > >
+    SmallVector(InputIter first, InputIter last, Allocator allocator = Allocator())
+        : SmallVector(allocator) {
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                      typename std::iterator_traits<InputIter>::iterator_category>) {
+            reserve(std::distance(first, last));
+        }
+        for (; first != last; ++first) {
+            emplace_back(*first);
+        }
+    }
+
+    SmallVector(std::initializer_list<T> items, Allocator allocator = Allocator())
+        : SmallVector(items.begin(), items.end(), allocator) {}
+
+    SmallVector(const SmallVector& other)
+        : SmallVector(traits_t::select_on_container_copy_construction(other.allocator_)) {
+        reserve(other.size_);
+        for (const T& item: other) {
+            emplace_back(item);
+        }
+    }
+
+    SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+        : SmallVector(other.allocator_) {
+        take_contents(other);
+    }
+
+    ~SmallVector() {
+        destroy_elements();
+        release_buffer();
+    }
+
+    SmallVector& operator=(const SmallVector& other) {
+        if (this == &other) {
+            return *this;
+        }
+        SmallVector copy(traits_t::propagate_on_container_copy_assignment::value
+                         ? other.allocator_ : allocator_);
+        copy.reserve(other.size_);
+        for (const T& item: other) {
+            copy.emplace_back(item);
+        }
+        destroy_elements();
+        release_buffer();
+        allocator_ = copy.allocator_;
+        take_contents(copy);
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept(
+            std::is_nothrow_move_constructible_v<T>
+            && (traits_t::propagate_on_container_move_assignment::value
+                || traits_t::is_always_equal::value)) {
+        if (this == &other) {
+            return *this;
+        }
+        destroy_elements();
+        if (traits_t::propagate_on_container_move_assignment::value
+            || traits_t::is_always_equal::value || allocator_ == other.allocator_) {
+            release_buffer();
+            if constexpr (traits_t::propagate_on_container_move_assignment::value) {
+                allocator_ = other.allocator_;
+            }
+            take_contents(other);
+        } else {
+            reserve(other.size_);
+            for (T& item: other) {
+                emplace_back(std::move(item));
+            }
+            other.destroy_elements();
+        }
+        return *this;
+    }
+
+    Allocator get_allocator() const {
+        return Allocator(allocator_);
+    }
+
+    size_t size() const noexcept {
+        return size_;
+    }
+
+    size_t capacity() const noexcept {
+        return capacity_;
+    }
+
+    bool empty() const noexcept {
+        return size_ == 0;
+    }
+
+    // True while the elements live inside the object.
+    bool is_inline() const noexcept {
+        return data_ == reinterpret_cast<const T*>(inline_);
+    }
+
+    T* data() noexcept {
+        return data_;
+    }
+
+    const T* data() const noexcept {
+        return data_;
+    }
+
+    T& operator[](size_t index) {
+        return data_[index];
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    T& at(size_t index) {
+        if (index >= size_) {
+            throw std::out_of_range("SmallVector::at");
+        }
+        return data_[index];
+    }
+
+    const T& at(size_t index) const {
+        if (index >= size_) {
+            throw std::out_of_range("SmallVector::at");
+        }
+        return data_[index];
+    }
+
+    T& front() {
+        return data_[0];
+    }
+
+    const T& front() const {
+        return data_[0];
+    }
+
+    T& back() {
+        return data_[size_ - 1];
+    }
+
+    const T& back() const {
+        return data_[size_ - 1];
+    }
+
+    void reserve(size_t count) {
+        if (count > capacity_) {
+            reallocate(count);
+        }
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (size_ == capacity_) {
+            reallocate(grown_capacity(size_ + 1), [&](T* ptr) {
+                traits_t::construct(allocator_, ptr, std::forward<Args>(args)...);
+            });
+        } else {
+            traits_t::construct(allocator_, data_ + size_, std::forward<Args>(args)...);
+        }
+        return data_[size_++];
+    }
+
+    void push_back(const T& item) {
+        emplace_back(item);
+    }
+
+    void push_back(T&& item) {
+        emplace_back(std::move(item));
+    }
+
+    void pop_back() {
+        traits_t::destroy(allocator_, data_ + --size_);
+    }
+
+    void resize(size_t count) {
+        reserve(count);
+        while (size_ < count) {
+            emplace_back();
+        }
+        while (size_ > count) {
+            pop_back();
+        }
+    }
+
+    void clear() noexcept {
+        destroy_elements();
+    }
+
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    // Removes the element at iter and shifts the rest down.
+    iterator erase(const_iterator iter) {
+        T* position = data_ + (iter - data_);
+        std::move(position + 1, data_ + size_, position);
+        pop_back();
+        return position;
+    }
+
+    iterator begin() noexcept {
+        return data_;
+    }
+
+    iterator end() noexcept {
+        return data_ + size_;
+    }
+
+    const_iterator begin() const noexcept {
+        return data_;
+    }
+
+    const_iterator end() const noexcept {
+        return data_ + size_;
+    }
+
+    const_iterator cbegin() const noexcept {
+        return data_;
+    }
+
+    const_iterator cend() const noexcept {
+        return data_ + size_;
+    }
+
+    reverse_iterator rbegin() noexcept {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() noexcept {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const noexcept {
+        return const_reverse_iterator(cend());
+    }
+
+    const_reverse_iterator crend() const noexcept {
+        return const_reverse_iterator(cbegin());
+    }
+};
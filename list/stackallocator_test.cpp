@@ -2,6 +2,10 @@
 #include <stdexcept>
 #include <string>
 #include <list>
+#include <set>
+#include <random>
+#include <numeric>
+#include <iterator>
 #include <vector>
 #include <deque>
 #include <memory>
@@ -10,10 +14,19 @@
 #include <algorithm>
 #include <sstream>
 #include <cassert>
+#include <thread>
+#include <atomic>
 #include <sys/resource.h>
 
-#include "list.cpp"
-//#include "list.h"
+//#include "list.cpp"
+#include "list.h"
+#include "intrusive_list.h"
+#include "concurrent_queue.h"
+#include "deque.h"
+#include "small_vector.h"
+#include "parallel_algorithms.h"
+#include "skip_list.h"
+#include "persistent_list.h"
 
 //template<typename T, typename Alloc = std::allocator<T>>
 //using List = std::list<T, Alloc>;
@@ -407,6 +420,605 @@ void TestWhimsicalAllocator() {
     }
 }
 
+void TestRangeInsertAndMove() {
+    std::vector<int> source = {1, 2, 3, 4, 5};
+
+    List<int> lst(source.begin(), source.end());
+    assert(lst.size() == 5);
+
+    auto it = lst.insert(std::next(lst.cbegin()), source.begin(), source.begin() + 2);
+    assert(*it == 1);
+    assert(lst.size() == 7);
+
+    std::string s;
+    for (int x: lst) {
+        s += std::to_string(x);
+    }
+    assert(s == "1122345");
+
+    List<int> moved = std::move(lst);
+    assert(moved.size() == 7);
+    assert(lst.size() == 0);
+
+    lst.assign(source.rbegin(), source.rend());
+    lst = std::move(moved);
+    assert(lst.size() == 7);
+    assert(*lst.rbegin() == 5);
+
+    lst.erase(lst.cbegin());
+    lst.push_front(0);
+    lst.compact();
+    s.clear();
+    for (int x: lst) {
+        s += std::to_string(x);
+    }
+    assert(s == "0122345");
+
+    List<std::unique_ptr<int>> pointers;
+    pointers.push_back(std::make_unique<int>(1));
+    pointers.emplace_front(new int(0));
+    pointers.emplace(pointers.cend(), std::make_unique<int>(2));
+    assert(pointers.size() == 3);
+    assert(**pointers.begin() == 0);
+    assert(**pointers.rbegin() == 2);
+
+    Accountant::reset();
+    ThrowingAccountant::need_throw = false;
+    List<ThrowingAccountant> accountants(3);
+    std::vector<ThrowingAccountant> more(10);
+    Accountant::reset();
+    ThrowingAccountant::need_throw = true;
+    bool thrown = false;
+    try {
+        accountants.insert(accountants.cend(), more.begin(), more.end());
+    } catch (...) {
+        thrown = true;
+        assert(Accountant::ctor_calls == 4);
+        assert(Accountant::dtor_calls == 4);
+    }
+    ThrowingAccountant::need_throw = false;
+    assert(thrown);
+    assert(accountants.size() == 3);
+}
+
+struct AllocationCounter {
+    static size_t allocations;
+    static size_t deallocations;
+    static size_t live_bytes;
+
+    static void reset() {
+        allocations = deallocations = live_bytes = 0;
+    }
+};
+
+size_t AllocationCounter::allocations = 0;
+size_t AllocationCounter::deallocations = 0;
+size_t AllocationCounter::live_bytes = 0;
+
+template <typename T>
+struct CountingAllocator : public std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = CountingAllocator<U>;
+    };
+
+    CountingAllocator() = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        ++AllocationCounter::allocations;
+        AllocationCounter::live_bytes += count * sizeof(T);
+        return std::allocator<T>::allocate(count);
+    }
+
+    void deallocate(T* ptr, size_t count) {
+        ++AllocationCounter::deallocations;
+        AllocationCounter::live_bytes -= count * sizeof(T);
+        std::allocator<T>::deallocate(ptr, count);
+    }
+};
+
+void TestRangeInsertBlocks() {
+    const size_t pairs = 40'000;
+    std::vector<int> two = {0, 0};
+
+    AllocationCounter::reset();
+    {
+        List<int, CountingAllocator<int>> lst;
+        for (size_t i = 0; i < pairs; ++i) {
+            two[0] = two[1] = static_cast<int>(i);
+            lst.insert(lst.cend(), two.begin(), two.end());
+        }
+        assert(lst.size() == 2 * pairs);
+        // Every insert allocates a block header and the nodes it owns.
+        assert(AllocationCounter::allocations == 2 * pairs);
+
+        // Erasing one node of a pair keeps its block alive.
+        for (auto it = lst.cbegin(); it != lst.cend(); ++it) {
+            it = lst.erase(it);
+        }
+        assert(lst.size() == pairs);
+        assert(AllocationCounter::deallocations == 0);
+
+        int expected = 0;
+        for (int x: lst) {
+            assert(x == expected++);
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        while (lst.size() > pairs / 2) {
+            lst.pop_front();
+        }
+        while (lst.size() > 0) {
+            lst.pop_back();
+        }
+        auto finish = std::chrono::high_resolution_clock::now();
+        assert(std::chrono::duration_cast<std::chrono::seconds>(finish - start).count() < 1);
+        assert(AllocationCounter::deallocations == AllocationCounter::allocations);
+        assert(AllocationCounter::live_bytes == 0);
+
+        // Input iterators fill geometrically growing blocks.
+        std::istringstream input("1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20");
+        lst.insert(lst.cend(), std::istream_iterator<int>(input), std::istream_iterator<int>());
+        assert(lst.size() == 20);
+        lst.push_front(0);
+        for (auto it = std::next(lst.cbegin(), 5); lst.size() > 10;) {
+            it = lst.erase(it);
+        }
+        lst.compact();
+        std::string s;
+        for (int x: lst) {
+            s += std::to_string(x) + " ";
+        }
+        assert(s == "0 1 2 3 4 16 17 18 19 20 ");
+    }
+    assert(AllocationCounter::deallocations == AllocationCounter::allocations);
+    assert(AllocationCounter::live_bytes == 0);
+}
+
+struct QueueTag {};
+
+struct PooledTask: IntrusiveListHook<>, IntrusiveListHook<QueueTag, true> {
+    int id;
+    explicit PooledTask(int id): id(id) {}
+};
+
+void TestIntrusiveList() {
+    using QueueHook = IntrusiveListHook<QueueTag, true>;
+
+    std::vector<PooledTask> pool;
+    for (int i = 0; i < 6; ++i) {
+        pool.emplace_back(i);
+    }
+
+    IntrusiveList<PooledTask> all;
+    IntrusiveList<PooledTask, QueueHook> queue;
+    for (auto& task: pool) {
+        all.push_back(task);
+        if (task.id % 2 == 1) {
+            queue.push_front(task);
+        }
+    }
+    assert(all.size() == 6);
+    assert(queue.size() == 3);
+
+    all.erase(pool[2]);
+    queue.erase(queue.iterator_to(pool[3]));
+    assert(!static_cast<QueueHook&>(pool[3]).is_linked());
+
+    std::string s;
+    for (const auto& task: all) {
+        s += std::to_string(task.id);
+    }
+    assert(s == "01345");
+
+    s.clear();
+    for (auto it = queue.crbegin(); it != queue.crend(); ++it) {
+        s += std::to_string(it->id);
+    }
+    assert(s == "15");
+
+    queue.clear();
+}
+
+void TestConcurrentQueue() {
+    {
+        ConcurrentQueue<std::string> queue;
+        std::string item;
+        assert(!queue.try_pop(item));
+        queue.push("a");
+        queue.emplace(2, 'b');
+        assert(queue.try_pop(item) && item == "a");
+        assert(queue.try_pop(item) && item == "bb");
+        assert(queue.empty());
+    }
+
+    StackStorage<2'000'000> storage;
+    ConcurrentQueue<int, StackAllocator<int, 2'000'000>> queue{StackAllocator<int, 2'000'000>(storage)};
+
+    const int producers = 2;
+    const int per_producer = 20'000;
+    std::atomic<int> popped{0};
+    std::atomic<long long> sum{0};
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            for (int i = 0; i < per_producer; ++i) {
+                queue.push(p * per_producer + i);
+            }
+        });
+    }
+    for (int c = 0; c < 2; ++c) {
+        threads.emplace_back([&] {
+            int item;
+            while (popped.load() < producers * per_producer) {
+                if (queue.try_pop(item)) {
+                    sum += item;
+                    ++popped;
+                }
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    long long total = producers * per_producer;
+    assert(sum == total * (total - 1) / 2);
+    assert(queue.empty());
+}
+
+template <typename Storage>
+void TestSharedStorage() {
+    constexpr size_t size = 20'000'000;
+    using Alloc = StackAllocator<int, size, Storage>;
+
+    auto storage = std::make_unique<Storage>();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+        threads.emplace_back([&] {
+            List<int, Alloc> lst{Alloc(*storage)};
+            for (int i = 0; i < 50'000; ++i) {
+                lst.push_back(i);
+            }
+            long long sum = 0;
+            for (int x: lst) {
+                sum += x;
+            }
+            assert(sum == 50'000LL * 49'999 / 2);
+
+            StackAllocator<long double, size, Storage> ldalloc{Alloc(*storage)};
+            auto* pld = ldalloc.allocate(3);
+            assert(reinterpret_cast<uintptr_t>(pld) % alignof(long double) == 0);
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+}
+
+void TestSharedStorageBounds() {
+    // A storage smaller than one chunk hands out its whole arena, then throws.
+    auto small = std::make_unique<ThreadLocalStackStorage<1000>>();
+    char* first = small->get_memory(100, 1);
+    char* second = small->get_memory(100, 1);
+    assert(second == first + 100);
+    bool thrown = false;
+    try {
+        small->get_memory(900, 1);
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    assert(thrown);
+    small->get_memory(700, 1);
+
+    // Alternating between more storages than a thread used to cache must not
+    // throw away the chunks it already holds.
+    using Storage = ThreadLocalStackStorage<4096, 1024>;
+    std::vector<std::unique_ptr<Storage>> storages;
+    for (int i = 0; i < 8; ++i) {
+        storages.push_back(std::make_unique<Storage>());
+    }
+    for (int round = 0; round < 200; ++round) {
+        for (auto& storage: storages) {
+            storage->get_memory(16, 16);
+        }
+    }
+
+    auto atomic = std::make_unique<AtomicStackStorage<1024>>();
+    atomic->get_memory(1000, 1);
+    thrown = false;
+    try {
+        atomic->get_memory(100, 1);
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void TestDeque() {
+    StackStorage<2'000'000> storage;
+    StackAllocator<int, 2'000'000> alloc(storage);
+
+    Deque<int, StackAllocator<int, 2'000'000>> d(alloc);
+    for (int i = 0; i < 5000; ++i) {
+        d.push_back(i);
+        d.push_front(-i - 1);
+    }
+    assert(d.size() == 10000);
+    assert(d.front() == -5000 && d.back() == 4999);
+    for (int i = 0; i < 10000; ++i) {
+        assert(d[i] == i - 5000);
+    }
+    assert(d.end() - d.begin() == 10000);
+    assert(*(d.begin() + 7000) == 2000);
+
+    std::reverse(d.begin(), d.end());
+    std::sort(d.begin(), d.end());
+    assert(std::is_sorted(d.cbegin(), d.cend()));
+    assert(*d.rbegin() == 4999);
+
+    bool thrown = false;
+    try {
+        d.at(10000);
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // Once warmed up, a queue of steady size reuses its blocks and does not
+    // take anything more from the arena.
+    auto probe = [&storage] {
+        return StackAllocator<char, 2'000'000>(storage).allocate(1);
+    };
+    d.reserve_front(3000);
+    char* before = probe();
+    for (int i = 0; i < 3000; ++i) {
+        d.push_front(i);
+    }
+    assert(probe() == before + 1);
+    for (int i = 0; i < 100'000; ++i) {
+        d.push_back(i);
+        d.pop_front();
+    }
+    before = probe();
+    for (int i = 100'000; i < 200'000; ++i) {
+        d.push_back(i);
+        d.pop_front();
+    }
+    char* after = probe();
+    assert(after == before + 1);
+    assert(d.size() == 13000 && d.back() == 199'999);
+
+    auto copy = d;
+    assert(copy.size() == d.size() && std::equal(copy.begin(), copy.end(), d.begin()));
+    auto moved = std::move(copy);
+    assert(copy.empty() && moved.front() == d.front());
+
+    Deque<std::unique_ptr<int>> owners;
+    for (int i = 0; i < 100; ++i) {
+        owners.push_back(std::make_unique<int>(i));
+    }
+    while (owners.size() > 1) {
+        owners.pop_front();
+    }
+    owners.shrink_to_fit();
+    assert(*owners.front() == 99);
+}
+
+void TestSmallVector() {
+    StackStorage<100'000> storage;
+    using Alloc = StackAllocator<std::string, 100'000>;
+    auto probe = [&storage] {
+        return StackAllocator<char, 100'000>(storage).allocate(1);
+    };
+
+    char* before = probe();
+    SmallVector<std::string, 4, Alloc> v{Alloc(storage)};
+    for (int i = 0; i < 4; ++i) {
+        v.push_back(std::string(i + 1, 'a'));
+    }
+    assert(v.is_inline() && probe() == before + 1);
+
+    v.push_back(v[0]);
+    assert(!v.is_inline() && v.size() == 5 && v.capacity() == 8);
+    assert(v.back() == "a" && v[3] == "aaaa");
+
+    v.erase(v.begin() + 1);
+    assert(v.size() == 4 && v[1] == "aaa");
+
+    auto copy = v;
+    assert(std::equal(copy.begin(), copy.end(), v.begin(), v.end()));
+
+    SmallVector<std::string, 4, Alloc> moved = std::move(copy);
+    assert(copy.empty() && copy.is_inline() && moved.size() == 4);
+
+    SmallVector<std::unique_ptr<int>, 2> owners;
+    owners.emplace_back(new int(1));
+    SmallVector<std::unique_ptr<int>, 2> inline_moved = std::move(owners);
+    assert(owners.empty() && *inline_moved[0] == 1);
+    for (int i = 2; i <= 10; ++i) {
+        inline_moved.emplace_back(new int(i));
+    }
+    owners = std::move(inline_moved);
+    assert(owners.size() == 10 && *owners.back() == 10);
+
+    SmallVector<int, 8> numbers = {5, 3, 1, 4, 2};
+    std::sort(numbers.begin(), numbers.end());
+    numbers.resize(3);
+    assert(numbers.is_inline() && numbers.size() == 3 && numbers[2] == 3);
+
+    // A throwing element constructed while growing must not be destroyed.
+    ThrowingAccountant::need_throw = false;
+    SmallVector<ThrowingAccountant, 3> accountants(3);
+    Accountant::reset();
+    std::vector<ThrowingAccountant> spare(3);
+    ThrowingAccountant::need_throw = true;
+    bool thrown = false;
+    try {
+        accountants.emplace_back(3);
+    } catch (...) {
+        thrown = true;
+    }
+    ThrowingAccountant::need_throw = false;
+    assert(thrown);
+    assert(Accountant::ctor_calls == 4 && Accountant::dtor_calls == 1);
+    assert(accountants.size() == 3 && accountants.is_inline());
+}
+
+void TestParallelAlgorithms() {
+    ThreadPool pool(3);
+
+    List<long long> lst;
+    for (int i = 1; i <= 100'000; ++i) {
+        lst.push_back(i);
+    }
+
+    assert(parallel_reduce(pool, lst, 0LL, std::plus<long long>()) == 5'000'050'000LL);
+    assert(parallel_count_if(pool, lst, [](long long x) { return x % 3 == 0; }) == 33'333);
+
+    auto chunks = make_chunks(lst, 10);
+    assert(chunks.size() == 10);
+    parallel_for_each(pool, chunks, [](long long& x) { x *= 2; });
+    // Split points survive inserts, which only make the chunks uneven.
+    lst.push_back(1);
+    lst.insert(std::next(lst.begin(), 500), 1);
+    assert(parallel_reduce(pool, chunks, 0LL, std::plus<long long>()) == 10'000'100'002LL);
+
+    // Non-commutative op: partial results are combined in order.
+    List<std::string> words;
+    for (int i = 0; i < 1000; ++i) {
+        words.push_back(std::to_string(i % 10));
+    }
+    std::string joined = parallel_reduce(pool, words, std::string(), std::plus<std::string>());
+    assert(joined.size() == 1000 && joined.substr(0, 12) == "012345678901");
+
+    bool thrown = false;
+    try {
+        parallel_for_each(pool, lst, [](long long x) {
+            if (x == 5000) {
+                throw std::runtime_error("5000");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // run() may be nested inside a task.
+    std::atomic<int> inner{0};
+    pool.run(4, [&](size_t) {
+        pool.run(4, [&](size_t) { ++inner; });
+    });
+    assert(inner == 16);
+}
+
+void TestSkipList() {
+    StackStorage<5'000'000> storage;
+    using Alloc = StackAllocator<int, 5'000'000>;
+
+    SkipList<int, std::less<int>, Alloc> skip{Alloc(storage)};
+    std::set<int> reference;
+    std::mt19937 gen(7);
+    for (int i = 0; i < 50'000; ++i) {
+        int key = gen() % 100'000;
+        assert(skip.insert(key).second == reference.insert(key).second);
+    }
+    for (int i = 0; i < 20'000; ++i) {
+        int key = gen() % 100'000;
+        assert(skip.erase(key) == reference.erase(key));
+    }
+    assert(skip.size() == reference.size());
+    assert(std::equal(skip.begin(), skip.end(), reference.begin(), reference.end()));
+    assert(std::equal(skip.rbegin(), skip.rend(), reference.rbegin(), reference.rend()));
+
+    for (int key = 0; key < 1000; ++key) {
+        auto found = skip.lower_bound(key * 100);
+        auto expected = reference.lower_bound(key * 100);
+        assert((found == skip.end()) == (expected == reference.end()));
+        assert(found == skip.end() || *found == *expected);
+        assert(skip.contains(key) == (reference.count(key) == 1));
+    }
+
+    // Range iteration over [from, to).
+    long long sum = 0;
+    for (auto it = skip.lower_bound(40'000); it != skip.upper_bound(59'999); ++it) {
+        sum += *it;
+    }
+    long long expected_sum = 0;
+    for (auto it = reference.lower_bound(40'000); it != reference.upper_bound(59'999); ++it) {
+        expected_sum += *it;
+    }
+    assert(sum == expected_sum);
+
+    auto copy = skip;
+    auto moved = std::move(copy);
+    assert(copy.empty() && std::equal(moved.begin(), moved.end(), skip.begin(), skip.end()));
+    for (auto it = moved.begin(); it != moved.end();) {
+        it = moved.erase(it);
+    }
+    assert(moved.empty() && moved.begin() == moved.end());
+
+    SkipList<std::string, std::greater<std::string>> words;
+    words.emplace("b");
+    words.emplace(3, 'a');
+    assert(!words.emplace("b").second);
+    assert(*words.begin() == "b" && *std::prev(words.end()) == "aaa");
+}
+
+void TestPersistentList() {
+    StackStorage<1'000'000> storage;
+    using Alloc = StackAllocator<int, 1'000'000>;
+
+    PersistentList<int, Alloc> base{Alloc(storage)};
+    for (int i = 0; i < 1000; ++i) {
+        base.push_front(i);
+    }
+    auto snapshot = base;
+    assert(snapshot.shares_with(base) && snapshot.size() == 1000);
+
+    base.pop_front();
+    base.push_front(-1);
+    auto branch = snapshot.with_front(1000);
+    assert(snapshot.front() == 999 && snapshot.size() == 1000);
+    assert(base.front() == -1 && *std::next(base.begin()) == 998);
+    assert(branch.front() == 1000 && branch.tail().shares_with(snapshot));
+    assert(std::accumulate(snapshot.begin(), snapshot.end(), 0LL) == 999 * 1000 / 2);
+
+    // Readers drop their snapshots on other threads while the writer goes on.
+    PersistentList<std::string> shared;
+    std::vector<std::thread> readers;
+    std::atomic<long long> total{0};
+    for (int r = 0; r < 4; ++r) {
+        for (int i = 0; i < 1000; ++i) {
+            shared.push_front(std::to_string(i));
+        }
+        readers.emplace_back([view = shared, &total] {
+            long long sum = 0;
+            for (const std::string& item: view) {
+                sum += std::stoi(item);
+            }
+            total += sum;
+        });
+        shared.clear();
+    }
+    for (auto& reader: readers) {
+        reader.join();
+    }
+    assert(total == 4 * 999 * 1000 / 2);
+
+    PersistentList<int> long_list;
+    for (int i = 0; i < 1'000'000; ++i) {
+        long_list.push_front(i);
+    }
+    PersistentList<int> from_range(base.begin(), base.end());
+    assert(from_range.size() == 1000 && std::equal(from_range.begin(), from_range.end(), base.begin()));
+}
+
 template <class List>
 int ListPerformanceTest(List&& l) {
     using namespace std::chrono;
@@ -621,6 +1233,48 @@ int main() {
     TestWhimsicalAllocator();
     
     std::cerr << "Test 7 (Allocator Awareness) passed." << std::endl;
+
+    TestRangeInsertAndMove();
+
+    std::cerr << "Test 8 (Range insert and move semantics) passed." << std::endl;
+
+    TestIntrusiveList();
+
+    std::cerr << "Test 9 (IntrusiveList) passed." << std::endl;
+
+    TestConcurrentQueue();
+
+    std::cerr << "Test 10 (ConcurrentQueue) passed." << std::endl;
+
+    TestSharedStorage<AtomicStackStorage<20'000'000>>();
+    TestSharedStorage<ThreadLocalStackStorage<20'000'000>>();
+    TestSharedStorageBounds();
+
+    std::cerr << "Test 11 (StackAllocator over shared storages) passed." << std::endl;
+
+    TestDeque();
+
+    std::cerr << "Test 12 (Deque) passed." << std::endl;
+
+    TestSmallVector();
+
+    std::cerr << "Test 13 (SmallVector) passed." << std::endl;
+
+    TestParallelAlgorithms();
+
+    std::cerr << "Test 14 (Parallel algorithms over List) passed." << std::endl;
+
+    TestSkipList();
+
+    std::cerr << "Test 15 (SkipList) passed." << std::endl;
+
+    TestPersistentList();
+
+    std::cerr << "Test 16 (PersistentList) passed." << std::endl;
+
+    TestRangeInsertBlocks();
+
+    std::cerr << "Test 17 (Range insert blocks) passed." << std::endl;
     
     std::cerr << "Starting performance test. First, let's test performance of different allocators with std::list." << std::endl;
 